@@ -3,6 +3,17 @@
 
 #include "esp_camera.h"
 
+// Sensor window in full-resolution (1600x1200) sensor coordinates
+struct RegionOfInterest {
+    bool enabled;
+    int x;
+    int y;
+    int width;
+    int height;
+    int outputWidth;
+    int outputHeight;
+};
+
 class CameraModule {
 public:
     CameraModule();
@@ -13,9 +24,14 @@ public:
     void turnOnFlash();
     void turnOffFlash();
     camera_fb_t* captureWithFlash();
+    bool setRegionOfInterest(int x, int y, int width, int height);
+    bool clearRegionOfInterest();
+    RegionOfInterest getRegionOfInterest();
 
 private:
     bool isInitialized;
+    framesize_t frameSize;
+    RegionOfInterest roi;
     void configureCamera(camera_config_t &config);
 };
 
@@ -26,13 +26,57 @@
 // Flash LED pin
 #define FLASH_LED_PIN      4
 
+// Sensor region of interest applied at boot, in 1600x1200 sensor coordinates
+// (can also be changed at runtime via /roi)
+#define ROI_ENABLED 0
+#define ROI_X 400
+#define ROI_Y 300
+#define ROI_WIDTH 800
+#define ROI_HEIGHT 600
+
 // Timing configuration
 #define CAPTURE_HOUR 15  // Hour to capture (24-hour format, 15 = 3pm)
 #define TIMEZONE_OFFSET -8  // PST is UTC-8
 #define DAYLIGHT_OFFSET 3600  // 1 hour for daylight saving time
 
-// Web server port
+// Deep-sleep capture mode for battery/solar units
+// When enabled the device sleeps between captures instead of running loop()
+#define DEEP_SLEEP_MODE 0
+#define SLEEP_CAPTURE_INTERVAL_MIN 60   // Minutes between scheduled captures
+#define SLEEP_WIFI_WINDOW_SEC 30        // How long to serve after each capture
+#define SLEEP_WIFI_CONNECT_TIMEOUT_MS 8000
+#define SLEEP_WARMUP_FRAMES 2           // Frames discarded while AE/AWB settle
+#define SLEEP_RETENTION_MAX_EVICTIONS 8 // Per wake when WiFi is unavailable
+
+// Estimated board current per phase, used for the average current log
+#define SLEEP_CAPTURE_CURRENT_MA 120
+#define SLEEP_WIFI_CURRENT_MA 180
+#define SLEEP_DEEP_CURRENT_UA 6000      // Includes the AMS1117 regulator quiescent draw
+
+// Retention: daily CAPTURE_HOUR shots are kept forever; other captures and
+// recordings are evicted oldest-first by age or when free space runs low
+#define RETENTION_DIR "/retention"
+#define RETENTION_LOW_FREE_MB 200             // Start evicting below this much free space
+#define RETENTION_HIGH_FREE_MB 400            // ...and stop once this much is free again
+#define RETENTION_CAPTURE_MAX_AGE_DAYS 30     // Manual/interval captures; 0 = no age limit
+#define RETENTION_RECORDING_MAX_AGE_DAYS 7    // 0 = no age limit
+#define RETENTION_TICK_MS 1000                // At most one deletion per tick
+
+// Stream recording to SD as segmented MJPEG AVI files
+#define RECORD_DIR "/rec"
+#define RECORD_FPS 10                          // Own capture rate while no stream feeds the recorder
+#define RECORD_SEGMENT_SECONDS 300             // Start a new file after this long
+#define RECORD_SEGMENT_MAX_BYTES (256UL * 1024 * 1024)
+#define RECORD_QUEUE_DEPTH 4                   // Frames buffered between capture and writer
+#define RECORD_FRAME_BUFFER_SIZE (160 * 1024)  // Per queued frame, in PSRAM
+#define RECORD_SYNC_FRAMES 10                  // Flush data and index every N frames
+
+// Web server: every route, including the live stream, is served on this port
 #define WEB_SERVER_PORT 80
+#define HTTP_MAX_OPEN_SOCKETS 10         // Must stay below LWIP_MAX_SOCKETS - 3
+#define HTTP_ASYNC_WORKERS 2             // Downloads, captures and listings
+#define HTTP_STREAM_WORKERS 2            // Concurrent live stream viewers
+#define HTTP_DOWNLOAD_CHUNK_SIZE (16 * 1024)
 
 // SD card configuration
 #define SD_MOUNT_POINT "/sdcard"
@@ -41,4 +85,23 @@
 #define IMAGE_PREFIX "/plant_"
 #define IMAGE_EXTENSION ".jpg"
 
+// Append-only image index (one "epoch,size,filename" line per saved image)
+#define IMAGE_INDEX_FILE "/images.idx"
+
+// Captures are written under a temp name and renamed once verified; the
+// journal lists saves in flight so boot recovery only looks at those
+#define IMAGE_TEMP_EXTENSION ".part"
+#define IMAGE_JOURNAL_FILE "/images.jnl"
+
+// Push upload of new captures to an HTTP collector
+#define UPLOAD_ENABLED 0
+#define UPLOAD_COLLECTOR_URL "http://192.168.1.10:8080/upload"
+#define UPLOAD_CURSOR_FILE "/upload.cur"
+#define UPLOAD_BATCH_SIZE 16             // Files per keep-alive connection
+#define UPLOAD_PIPELINE_DEPTH 2          // Files read ahead from SD
+#define UPLOAD_BUFFER_SIZE (512 * 1024)  // Per pipeline slot, in PSRAM
+#define UPLOAD_BACKOFF_MIN_MS 1000
+#define UPLOAD_BACKOFF_MAX_MS 60000
+#define UPLOAD_IDLE_POLL_MS 2000
+
 #endif
@@ -0,0 +1,91 @@
+#ifndef IMAGE_STORE_H
+#define IMAGE_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+// Free of Arduino types so the save/commit/recover path also builds and
+// runs in the native test env (test/test_image_store)
+
+enum RetentionClass {
+    RETAIN_DAILY,      // The scheduled CAPTURE_HOUR shot; never evicted
+    RETAIN_CAPTURE,    // Manual and interval captures
+    RETAIN_RECORDING   // Stream recording segments
+};
+
+// The filesystem calls the save path needs: SD_MMC on the device, a fake
+// with injected power cuts in the host test
+class FileOps {
+public:
+    virtual ~FileOps() {}
+    virtual bool exists(const char* path) = 0;
+    virtual long size(const char* path) = 0;  // -1 if missing
+    virtual size_t read(const char* path, size_t offset, uint8_t* buf, size_t len) = 0;
+    virtual bool write(const char* path, const uint8_t* data, size_t len) = 0;  // Create or replace
+    virtual bool append(const char* path, const uint8_t* data, size_t len) = 0;
+    virtual bool truncate(const char* path, size_t len) = 0;
+    virtual bool rename(const char* from, const char* to) = 0;
+    virtual bool remove(const char* path) = 0;
+};
+
+// One "epoch,size,filename" line; journal lines add ",class"
+struct IndexLine {
+    long epoch;
+    size_t size;
+    std::string filename;
+    int retainClass;  // -1 when the line has no class field
+};
+
+// Told about each image once it is committed and indexed, including images
+// finished by recovery, so they still reach a retention queue
+class ImageCommitListener {
+public:
+    virtual ~ImageCommitListener() {}
+    virtual void imageCommitted(const std::string& filename, size_t size, RetentionClass cls, long epoch) = 0;
+};
+
+struct RecoveryStats {
+    int recovered;  // Committed (or found already committed) from the journal
+    int discarded;  // Temp files that never got all their bytes
+    int indexed;    // Index lines the cut had kept from being written
+};
+
+// Power-loss-safe image saves: journal the save, write a temp file, verify
+// it on the card, rename, index, then clear the journal. Callers serialize
+// save() so the journal never holds more than the save in flight, and
+// save() refuses to run until recover() has cleared any earlier journal.
+class ImageStore {
+public:
+    ImageStore(FileOps* fs, const char* indexPath, const char* journalPath, const char* tempSuffix);
+
+    void setListener(ImageCommitListener* l) { listener = l; }
+    bool save(const uint8_t* buf, size_t len, const std::string& filename, RetentionClass cls, long epoch);
+    RecoveryStats recover();
+    bool isRecovered() const { return recovered; }
+
+    // Append-only line files (index, journal, retention queues). Appends
+    // first cut back a torn last line, so a line is never glued onto a
+    // fragment; reads skip complete lines that do not parse.
+    bool appendLine(const char* path, const IndexLine& line);
+    bool readLine(const char* path, size_t offset, IndexLine& line, size_t& nextOffset);
+    bool repairTail(const char* path);
+
+    static bool isCompleteJpeg(const uint8_t* buf, size_t len);
+
+private:
+    FileOps* fs;
+    const char* indexPath;
+    const char* journalPath;
+    const char* tempSuffix;
+    ImageCommitListener* listener;
+    bool recovered;  // No journal left over; cleared again if removing one fails
+
+    bool clearJournal();
+    bool verifyFile(const std::string& path, size_t size);
+    bool commit(const std::string& filename, size_t size);
+    bool isLastIndexed(const std::string& filename);
+    static bool parseLine(const std::string& text, IndexLine& line);
+};
+
+#endif
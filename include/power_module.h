@@ -0,0 +1,42 @@
+#ifndef POWER_MODULE_H
+#define POWER_MODULE_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "time_module.h"
+
+// Survives deep sleep in RTC slow memory; reset on power-on
+struct SleepState {
+    uint32_t magic;
+    uint32_t wakeCount;
+    int nextImageNumber;
+    int lastDailyCaptureDay;  // Day of year of the last CAPTURE_HOUR shot
+    uint64_t captureUs;   // Cumulative time spent waking and capturing
+    uint64_t wifiUs;      // Cumulative time spent in the WiFi window
+    uint64_t sleepUs;     // Cumulative programmed deep-sleep time
+};
+
+class PowerModule {
+public:
+    PowerModule();
+
+    bool begin();
+    bool hasSavedState();
+    bool isTimerWake();
+    int getNextImageNumber();
+    void setNextImageNumber(int number);
+    bool claimDailyCapture(TimeModule* timeModule);
+    void releaseDailyCapture();
+    void markCaptureDone();
+    void markWiFiDone();
+    void sleepUntilNextCapture(TimeModule* timeModule);
+
+private:
+    bool stateValid;
+    uint64_t captureDoneUs;
+    uint64_t wifiDoneUs;
+    uint64_t nextSleepDurationUs(TimeModule* timeModule);
+    void logAverageCurrent();
+};
+
+#endif
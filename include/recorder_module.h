@@ -0,0 +1,89 @@
+#ifndef RECORDER_MODULE_H
+#define RECORDER_MODULE_H
+
+#include <Arduino.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "config.h"
+#include "camera_module.h"
+#include "sd_card_module.h"
+#include "time_module.h"
+#include "retention_module.h"
+
+// A JPEG copied out of the camera frame buffer, waiting for the writer
+struct RecordFrame {
+    uint8_t* buf;
+    size_t len;
+    uint16_t width;
+    uint16_t height;
+};
+
+struct RecorderStats {
+    bool recording;
+    uint32_t framesWritten;
+    uint32_t framesDropped;
+    uint32_t segments;
+    float fps;  // Frames written per second in the current segment
+    String currentSegment;
+};
+
+// One open AVI file plus its sidecar index
+struct AviSegment {
+    File avi;
+    File idx;
+    String path;
+    uint32_t frames;
+    uint32_t moviBytes;  // Bytes of chunks after the 'movi' fourcc
+    uint32_t maxFrameSize;
+    uint16_t width;
+    uint16_t height;
+    unsigned long startMs;
+};
+
+class RecorderModule {
+public:
+    RecorderModule(CameraModule* cam, SDCardModule* sd, TimeModule* tm, RetentionModule* rm);
+
+    bool begin();
+    bool start();
+    void stop();
+    RecorderStats getStats();
+
+    // Called by stream workers with the frame they are about to send
+    void offerFrame(const camera_fb_t* fb);
+
+private:
+    CameraModule* camera;
+    SDCardModule* sdCard;
+    TimeModule* timeModule;
+    RetentionModule* retention;
+    bool started;
+    volatile bool recording;
+    QueueHandle_t freeFrames;
+    QueueHandle_t readyFrames;
+    SemaphoreHandle_t statsMutex;  // Guards the segment fields and framesDropped
+    volatile unsigned long lastOfferMs;  // When a stream last fed the recorder
+    RecordFrame frames[RECORD_QUEUE_DEPTH];
+    AviSegment segment;
+    bool segmentOpen;
+    int segmentCounter;
+
+    uint32_t framesWritten;
+    uint32_t framesDropped;
+    uint32_t segments;
+
+    bool enqueueFrame(const camera_fb_t* fb);
+    void countDropped();
+    bool openSegment(uint16_t width, uint16_t height);
+    bool writeFrame(const RecordFrame* frame);
+    void closeSegment();
+    bool finalizeAvi(File& avi, const String& idxPath, uint32_t entries, uint32_t moviBytes,
+                     uint16_t width, uint16_t height, uint32_t usPerFrame, uint32_t maxFrameSize);
+    void recoverSegments();
+    String nextSegmentPath();
+    static void captureTask(void* param);
+    static void writerTask(void* param);
+};
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef RETENTION_MODULE_H
+#define RETENTION_MODULE_H
+
+#include <Arduino.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "config.h"
+#include "sd_card_module.h"
+#include "time_module.h"
+
+// Append-only queue of evictable files for one class, oldest at the head
+struct RetentionQueue {
+    const char* name;
+    uint32_t maxAgeDays;  // 0 = only evicted under space pressure
+    size_t headOffset;    // Persisted; everything before it has been evicted
+    time_t headStamp;     // Persisted; synced time first seen for a pre-NTP head
+    size_t nextOffset;
+    IndexEntry head;
+    bool hasHead;
+};
+
+struct RetentionStats {
+    uint64_t freeBytes;
+    bool underPressure;
+    uint32_t evicted;
+    String lastEvicted;
+};
+
+// RetentionClass lives in image_store.h, since image saves journal it
+class RetentionModule : public ImageCommitListener {
+public:
+    RetentionModule(SDCardModule* sd, TimeModule* tm);
+
+    bool begin();
+    void track(RetentionClass cls, const String& path, size_t size, time_t epoch = 0);
+    void imageCommitted(const std::string& filename, size_t size, RetentionClass cls, long epoch) override;
+    void service();
+    int catchUp(int maxEvictions);
+    RetentionStats getStats();
+
+private:
+    SDCardModule* sdCard;
+    TimeModule* timeModule;
+    bool started;
+    SemaphoreHandle_t queueMutex;
+    SemaphoreHandle_t statsMutex;  // Guards lastEvicted, which getStats() copies
+    RetentionQueue queues[2];
+
+    unsigned long lastServiceMs;
+    uint64_t freeBytes;
+    bool underPressure;
+    bool warnedNothingToEvict;
+    uint32_t evicted;
+    String lastEvicted;
+
+    String queuePath(int i);
+    String headPath(int i);
+    bool loadHead(int i);
+    void saveHead(int i);
+    int pickVictim();
+    void evictHead(int i);
+    bool step();
+};
+
+#endif
@@ -5,25 +5,79 @@
 #include "FS.h"
 #include "esp_camera.h"
 #include <vector>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "image_store.h"
 
 struct ImageInfo {
     String filename;
     size_t size;
 };
 
+struct IndexEntry {
+    time_t epoch;
+    size_t size;
+    String filename;
+};
+
+// FileOps on SD_MMC; one mutex keeps appends and reads from interleaving
+class SdFileOps : public FileOps {
+public:
+    SdFileOps();
+    void begin();
+
+    bool exists(const char* path) override;
+    long size(const char* path) override;
+    size_t read(const char* path, size_t offset, uint8_t* buf, size_t len) override;
+    bool write(const char* path, const uint8_t* data, size_t len) override;
+    bool append(const char* path, const uint8_t* data, size_t len) override;
+    bool truncate(const char* path, size_t len) override;
+    bool rename(const char* from, const char* to) override;
+    bool remove(const char* path) override;
+
+private:
+    SemaphoreHandle_t mutex;
+};
+
 class SDCardModule {
 public:
     SDCardModule();
 
     bool init();
-    bool saveImage(camera_fb_t* fb, const String& filename);
+    bool saveImage(camera_fb_t* fb, const String& filename, RetentionClass cls);
+    void setCommitListener(ImageCommitListener* listener);
+    void recoverPendingImages();
     std::vector<ImageInfo> listImages();
-    File openFile(const String& filename);
+    File openFile(const String& filename, const char* mode = FILE_READ);
+    bool exists(const String& path);
+    bool removeFile(const String& path);
+    bool ensureDir(const String& path);
+    uint64_t freeBytes();
     int getNextImageNumber();
 
+    // Image index, in save order
+    bool readIndexEntry(size_t offset, IndexEntry& entry, size_t& nextOffset);
+    size_t getIndexEntryCount();
+
+    // Same line format, for other append-only queues (e.g. retention)
+    bool appendIndexEntry(const String& path, const String& filename, size_t size, time_t epoch = 0);
+    bool readIndexEntry(const String& path, size_t offset, IndexEntry& entry, size_t& nextOffset);
+
+    // Small state files, replaced via a temp file so a power cut keeps one copy
+    bool writeStateFile(const String& path, const String& contents);
+    String readStateFile(const String& path);
+
 private:
     bool isInitialized;
+    bool bootRecoveryDone;  // Guarded by saveMutex, as are the two below
+    bool indexCounted;
+    size_t indexEntryCount;
+    SemaphoreHandle_t saveMutex;
+    SdFileOps fileOps;
+    ImageStore store;
     void printCardInfo();
+    void recoverLocked();
+    size_t countIndexEntries();
 };
 
 #endif
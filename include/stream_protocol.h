@@ -0,0 +1,19 @@
+#ifndef STREAM_PROTOCOL_H
+#define STREAM_PROTOCOL_H
+
+// Wire format shared by the firmware and the Linux aggregator (src/aggregator)
+
+// Live stream: multipart JPEG parts, each followed by a boundary line
+#define STREAM_PATH "/stream"
+#define PART_BOUNDARY "123456789000000000000987654321"
+#define STREAM_CONTENT_TYPE "multipart/x-mixed-replace;boundary=" PART_BOUNDARY
+#define STREAM_BOUNDARY "\r\n--" PART_BOUNDARY "\r\n"
+#define STREAM_PART "Content-Type: image/jpeg\r\nContent-Length: %u\r\n\r\n"
+
+// Image index: raw "epoch,size,filename" lines from byte ?offset= onwards
+#define INDEX_PATH "/index"
+
+// Single file by its index filename: /download?file=<filename>
+#define DOWNLOAD_PATH "/download"
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef TIME_MODULE_H
+#define TIME_MODULE_H
+
+#include <Arduino.h>
+#include <time.h>
+
+class TimeModule {
+public:
+    TimeModule();
+
+    static void applyTimezone();
+    void begin();
+    bool isSynced();
+    static bool isValidEpoch(time_t t);
+    bool getTime(struct tm* timeinfo);
+    String timestamp();
+    String generateImageFilename(int imageNumber);
+
+private:
+    bool started;
+};
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef UPLOAD_MODULE_H
+#define UPLOAD_MODULE_H
+
+#include <Arduino.h>
+#include <HTTPClient.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "config.h"
+#include "sd_card_module.h"
+
+// One read-ahead slot: a file loaded from SD waiting to be sent
+struct UploadItem {
+    uint8_t* buf;
+    size_t len;
+    char filename[64];
+    size_t nextOffset;  // Index offset just past this entry
+    bool skip;          // Missing or oversized file; only advances the cursor
+};
+
+struct UploadStats {
+    size_t queueDepth;      // Index entries not yet uploaded
+    size_t uploadedCount;   // Index entries behind the cursor, including skipped ones
+    uint32_t filesSent;
+    uint32_t failures;
+    uint32_t rejected;      // Files skipped after a non-retryable 4xx
+    uint64_t bytesSent;
+    float lastBatchKBps;
+    uint32_t backoffMs;
+};
+
+class UploadModule {
+public:
+    UploadModule(SDCardModule* sd);
+
+    bool begin();
+    bool isEnabled();
+    UploadStats getStats();
+
+private:
+    SDCardModule* sdCard;
+    bool enabled;
+    QueueHandle_t freeSlots;
+    QueueHandle_t readySlots;
+    UploadItem slots[UPLOAD_PIPELINE_DEPTH];
+
+    // Persisted cursor: next index entry to upload
+    size_t cursorOffset;
+    size_t uploadedCount;
+
+    uint32_t filesSent;
+    uint32_t failures;
+    uint32_t rejected;
+    uint64_t bytesSent;
+    float lastBatchKBps;
+    uint32_t backoffMs;
+
+    void loadCursor();
+    void saveCursor();
+    bool loadItem(UploadItem* item, const IndexEntry& entry);
+    int sendItem(HTTPClient& http, UploadItem* item);
+    static bool isRetryable(int code);
+    static void readerTask(void* param);
+    static void uploaderTask(void* param);
+};
+
+#endif
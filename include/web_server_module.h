@@ -1,37 +1,93 @@
 #ifndef WEB_SERVER_MODULE_H
 #define WEB_SERVER_MODULE_H
 
-#include <WebServer.h>
+#include <Arduino.h>
+#include <atomic>
 #include "esp_http_server.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "camera_module.h"
 #include "sd_card_module.h"
+#include "time_module.h"
+#include "upload_module.h"
+#include "recorder_module.h"
+#include "retention_module.h"
+
+class WebServerModule;
+
+typedef esp_err_t (WebServerModule::*RouteHandler)(httpd_req_t *req);
+
+// Fixed set of worker tasks; a request is rejected with 503 when all are busy
+struct AsyncPool {
+    QueueHandle_t jobs;
+    SemaphoreHandle_t idle;
+};
+
+struct Route {
+    const char* uri;
+    RouteHandler handler;
+    AsyncPool* pool;  // NULL runs inline on the httpd task
+    WebServerModule* server;
+};
+
+struct AsyncJob {
+    httpd_req_t* req;
+    Route* route;
+};
 
 class WebServerModule {
 public:
-    WebServerModule(CameraModule* cam, SDCardModule* sd, int* imgCount);
+    WebServerModule(CameraModule* cam, SDCardModule* sd, TimeModule* tm, UploadModule* up,
+                    RecorderModule* rec, RetentionModule* rm, std::atomic<int>* imgCount);
 
     bool init();
-    void handleClient();
     void printServerInfo();
 
 private:
-    WebServer server;
-    httpd_handle_t stream_httpd;
+    httpd_handle_t httpd;
     CameraModule* camera;
     SDCardModule* sdCard;
-    int* imageCount;
+    TimeModule* timeModule;
+    UploadModule* uploader;
+    RecorderModule* recorder;
+    RetentionModule* retention;
+    std::atomic<int>* imageCount;  // -1 until SD recovery has finished
+
+    SemaphoreHandle_t captureMutex;
+    AsyncPool jobPool;
+    AsyncPool streamPool;
+    Route routes[15];
 
     // Route handlers
-    void handleRoot();
-    static esp_err_t streamHandler(httpd_req_t *req);
-    void handleCapture();
-    void handleList();
-    void handleDownload();
-    void handleFlashOn();
-    void handleFlashOff();
+    esp_err_t handleRoot(httpd_req_t *req);
+    esp_err_t handleStream(httpd_req_t *req);
+    esp_err_t handleCapture(httpd_req_t *req);
+    esp_err_t handleList(httpd_req_t *req);
+    esp_err_t handleDownload(httpd_req_t *req);
+    esp_err_t handleIndex(httpd_req_t *req);
+    esp_err_t handleFlashOn(httpd_req_t *req);
+    esp_err_t handleFlashOff(httpd_req_t *req);
+    esp_err_t handleUploadStatus(httpd_req_t *req);
+    esp_err_t handleRoi(httpd_req_t *req);
+    esp_err_t handleRoiReset(httpd_req_t *req);
+    esp_err_t handleRecordStart(httpd_req_t *req);
+    esp_err_t handleRecordStop(httpd_req_t *req);
+    esp_err_t handleRecordStatus(httpd_req_t *req);
+    esp_err_t handleRetentionStatus(httpd_req_t *req);
+
+    // Dispatch
+    bool startPool(AsyncPool* pool, int workers, const char* name);
+    esp_err_t submitAsync(httpd_req_t *req, Route* route);
+    static esp_err_t dispatchRoute(httpd_req_t *req);
+    static void asyncWorkerTask(void* param);
 
     // Helper functions
     String captureAndSaveImage();
+    esp_err_t sendRoiStatus(httpd_req_t *req);
+    String getQueryParam(httpd_req_t *req, const char* key);
+    esp_err_t sendHTML(httpd_req_t *req, const String& html);
+    esp_err_t redirectHome(httpd_req_t *req);
     String generateHTMLHeader(const String& title);
     String generateHTMLFooter();
 };
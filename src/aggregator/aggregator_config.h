@@ -0,0 +1,25 @@
+#ifndef AGGREGATOR_CONFIG_H
+#define AGGREGATOR_CONFIG_H
+
+// Listening port for viewers
+#define AGG_DEFAULT_PORT 8080
+
+// Local mirror of each camera's image archive (<dir>/<camera name>/)
+#define AGG_DEFAULT_ARCHIVE_DIR "./archive"
+
+// Camera ingest
+#define AGG_CAMERA_PORT 80               // Firmware WEB_SERVER_PORT
+#define AGG_CONNECT_TIMEOUT_SEC 5
+#define AGG_RECV_TIMEOUT_SEC 10          // Reconnect if a stream stalls this long
+#define AGG_RECONNECT_DELAY_MS 2000
+#define AGG_MAX_FRAME_SIZE (2 * 1024 * 1024)
+
+// Archive mirroring
+#define AGG_INDEX_POLL_SEC 60
+
+// Viewers
+#define AGG_CLIENT_SEND_TIMEOUT_SEC 5    // Drop viewers that stop reading
+#define AGG_THUMB_MAX_WIDTH 200
+#define AGG_THUMB_QUALITY 70
+
+#endif
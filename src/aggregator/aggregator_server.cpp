@@ -0,0 +1,271 @@
+#include "aggregator_server.h"
+#include "aggregator_config.h"
+#include "http_util.h"
+#include "stream_protocol.h"
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+static const char* statusText(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 503: return "Service Unavailable";
+        default:  return "Internal Server Error";
+    }
+}
+
+AggregatorServer::AggregatorServer(int port, const std::vector<Camera>& cameras)
+    : port(port), listenFd(-1), cameras(cameras) {}
+
+bool AggregatorServer::begin() {
+    listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listenFd < 0) {
+        perror("socket");
+        return false;
+    }
+
+    int one = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+
+    if (bind(listenFd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(listenFd, 64) < 0) {
+        perror("bind");
+        close(listenFd);
+        listenFd = -1;
+        return false;
+    }
+
+    printf("Aggregator listening on port %d\n", port);
+    return true;
+}
+
+void AggregatorServer::run() {
+    while (listenFd >= 0) {
+        int fd = accept(listenFd, NULL, NULL);
+        if (fd < 0) {
+            continue;
+        }
+
+        // A viewer that stops reading must not hold a frame forever
+        struct timeval tv = { AGG_CLIENT_SEND_TIMEOUT_SEC, 0 };
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+        std::thread(&AggregatorServer::handleClient, this, fd).detach();
+    }
+}
+
+Camera* AggregatorServer::findCamera(const std::string& name) {
+    for (Camera& cam : cameras) {
+        if (cam.feed->getName() == name) {
+            return &cam;
+        }
+    }
+    return NULL;
+}
+
+// One request per connection; every response is sent with Connection: close
+void AggregatorServer::handleClient(int fd) {
+    SocketSource source(fd);
+    BufferedReader in(&source);
+    std::string requestLine;
+    std::map<std::string, std::string> headers;
+
+    if (!in.readLine(requestLine) || !readHeaders(in, headers)) {
+        close(fd);
+        return;
+    }
+
+    // "GET /path?query HTTP/1.1"
+    size_t sp1 = requestLine.find(' ');
+    size_t sp2 = requestLine.find(' ', sp1 + 1);
+    if (sp1 == std::string::npos || requestLine.compare(0, sp1, "GET") != 0) {
+        sendError(fd, 400, "Only GET is supported");
+        close(fd);
+        return;
+    }
+    std::string path = requestLine.substr(sp1 + 1, sp2 == std::string::npos ? std::string::npos : sp2 - sp1 - 1);
+    path = path.substr(0, path.find('?'));
+
+    if (path == "/") {
+        handleIndex(fd);
+    } else if (path == "/cams") {
+        handleCams(fd);
+    } else if (path.compare(0, 5, "/cam/") == 0) {
+        // /cam/<name>/<resource>
+        size_t slash = path.find('/', 5);
+        Camera* cam = findCamera(path.substr(5, slash == std::string::npos ? std::string::npos : slash - 5));
+        std::string resource = slash == std::string::npos ? "" : path.substr(slash + 1);
+
+        if (!cam) {
+            sendError(fd, 404, "Unknown camera");
+        } else if (resource == "stream") {
+            handleStream(fd, cam->feed);
+        } else if (resource == "snapshot.jpg") {
+            handleImage(fd, cam->feed->getSnapshot());
+        } else if (resource == "thumb.jpg") {
+            handleImage(fd, cam->feed->getThumbnail());
+        } else if (resource == "archive") {
+            handleArchiveList(fd, cam);
+        } else if (resource.compare(0, 8, "archive/") == 0) {
+            handleArchiveFile(fd, cam, resource.substr(8));
+        } else {
+            sendError(fd, 404, "Not found");
+        }
+    } else {
+        sendError(fd, 404, "Not found");
+    }
+
+    close(fd);
+}
+
+void AggregatorServer::handleIndex(int fd) {
+    std::string html = "<!DOCTYPE html><html><head><title>Plant Cameras</title>"
+                       "<meta http-equiv='refresh' content='30'>"
+                       "<style>body{font-family:Arial;margin:20px}"
+                       ".cam{display:inline-block;margin:10px;text-align:center}</style>"
+                       "</head><body><h1>Plant Cameras</h1>";
+
+    for (Camera& cam : cameras) {
+        const std::string& name = cam.feed->getName();
+        FeedStats stats = cam.feed->getStats();
+        html += "<div class='cam'><a href='/cam/" + name + "/stream'>"
+                "<img src='/cam/" + name + "/thumb.jpg' width='" + std::to_string(AGG_THUMB_MAX_WIDTH) + "'></a><br>"
+                "<b>" + name + "</b> " + (stats.connected ? "online" : "offline") +
+                "<br><a href='/cam/" + name + "/snapshot.jpg'>Snapshot</a> | "
+                "<a href='/cam/" + name + "/archive'>Archive</a></div>";
+    }
+
+    html += "</body></html>";
+    sendResponse(fd, 200, "text/html", html);
+}
+
+void AggregatorServer::handleCams(int fd) {
+    std::string json = "[";
+    for (size_t i = 0; i < cameras.size(); i++) {
+        CameraFeed* feed = cameras[i].feed;
+        FeedStats stats = feed->getStats();
+        if (i > 0) {
+            json += ",";
+        }
+        json += "{\"name\":\"" + feed->getName() + "\"";
+        json += ",\"host\":\"" + feed->getHost() + "\"";
+        json += ",\"connected\":" + std::string(stats.connected ? "true" : "false");
+        json += ",\"frames\":" + std::to_string(stats.framesReceived);
+        json += ",\"bytes\":" + std::to_string(stats.bytesReceived);
+        json += ",\"reconnects\":" + std::to_string(stats.reconnects);
+        json += ",\"viewers\":" + std::to_string(stats.viewers) + "}";
+    }
+    json += "]";
+    sendResponse(fd, 200, "application/json", json);
+}
+
+// Every viewer shares the feed's single upstream connection
+void AggregatorServer::handleStream(int fd, CameraFeed* feed) {
+    std::string header = "HTTP/1.1 200 OK\r\n"
+                         "Content-Type: " STREAM_CONTENT_TYPE "\r\n"
+                         "Cache-Control: no-cache\r\n"
+                         "Connection: close\r\n\r\n";
+    if (!sendAll(fd, header)) {
+        return;
+    }
+
+    feed->addViewer();
+    uint64_t lastSeq = 0;
+    char part[64];
+    while (true) {
+        FramePtr frame = feed->waitForFrame(lastSeq, 1000);
+        if (!frame) {
+            // Notice viewers that left while the camera was quiet
+            char c;
+            if (recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) == 0) {
+                break;
+            }
+            continue;
+        }
+        size_t hlen = snprintf(part, sizeof(part), STREAM_PART, (unsigned)frame->size());
+        if (!sendAll(fd, part, hlen) || !sendAll(fd, *frame) || !sendAll(fd, STREAM_BOUNDARY, strlen(STREAM_BOUNDARY))) {
+            break;
+        }
+    }
+    feed->removeViewer();
+}
+
+void AggregatorServer::handleImage(int fd, FramePtr frame) {
+    if (!frame) {
+        sendError(fd, 503, "No frame yet");
+        return;
+    }
+    sendResponse(fd, 200, "image/jpeg", *frame);
+}
+
+void AggregatorServer::handleArchiveList(int fd, Camera* cam) {
+    const std::string& name = cam->feed->getName();
+    std::vector<MirroredImage> images = cam->mirror->listImages();
+
+    std::string html = "<!DOCTYPE html><html><head><title>" + name + " archive</title>"
+                       "<style>body{font-family:Arial;margin:20px}</style></head><body>"
+                       "<h1>" + name + " archive</h1><p>" + std::to_string(images.size()) + " images</p><ul>";
+    for (const MirroredImage& image : images) {
+        html += "<li><a href='/cam/" + name + "/archive/" + image.name + "'>" + image.name + "</a> (" +
+                std::to_string(image.size / 1024) + " KB)</li>";
+    }
+    html += "</ul><a href='/'>Back</a></body></html>";
+    sendResponse(fd, 200, "text/html", html);
+}
+
+void AggregatorServer::handleArchiveFile(int fd, Camera* cam, const std::string& file) {
+    // Only plain names inside the camera's directory
+    if (file.empty() || file.find('/') != std::string::npos || file.find("..") != std::string::npos) {
+        sendError(fd, 400, "Bad file name");
+        return;
+    }
+
+    std::string path = cam->mirror->getDir() + "/" + file;
+    FILE* f = fopen(path.c_str(), "rb");
+    struct stat st;
+    if (!f || fstat(fileno(f), &st) != 0) {
+        if (f) {
+            fclose(f);
+        }
+        sendError(fd, 404, "File not found");
+        return;
+    }
+
+    std::string header = "HTTP/1.1 200 OK\r\nContent-Type: image/jpeg\r\nContent-Length: " +
+                         std::to_string(st.st_size) + "\r\nConnection: close\r\n\r\n";
+    if (sendAll(fd, header)) {
+        char chunk[16 * 1024];
+        size_t n;
+        while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0 && sendAll(fd, chunk, n)) {
+        }
+    }
+    fclose(f);
+}
+
+void AggregatorServer::sendResponse(int fd, int status, const char* contentType, const std::string& body) {
+    std::string header = "HTTP/1.1 " + std::to_string(status) + " " + statusText(status) + "\r\n"
+                         "Content-Type: " + contentType + "\r\n"
+                         "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                         "Cache-Control: no-cache\r\n"
+                         "Connection: close\r\n\r\n";
+    if (sendAll(fd, header)) {
+        sendAll(fd, body);
+    }
+}
+
+void AggregatorServer::sendError(int fd, int status, const char* message) {
+    sendResponse(fd, status, "text/plain", message);
+}
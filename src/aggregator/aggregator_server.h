@@ -0,0 +1,41 @@
+#ifndef AGGREGATOR_SERVER_H
+#define AGGREGATOR_SERVER_H
+
+#include <string>
+#include <vector>
+#include "archive_mirror.h"
+#include "camera_feed.h"
+
+struct Camera {
+    CameraFeed* feed;
+    ArchiveMirror* mirror;
+};
+
+// Serves every camera's live stream, snapshots and mirrored archive on one port
+class AggregatorServer {
+public:
+    AggregatorServer(int port, const std::vector<Camera>& cameras);
+
+    bool begin();
+    void run();  // Accept loop; one thread per viewer connection
+
+private:
+    int port;
+    int listenFd;
+    std::vector<Camera> cameras;
+
+    void handleClient(int fd);
+    Camera* findCamera(const std::string& name);
+
+    void handleIndex(int fd);
+    void handleCams(int fd);
+    void handleStream(int fd, CameraFeed* feed);
+    void handleImage(int fd, FramePtr frame);
+    void handleArchiveList(int fd, Camera* cam);
+    void handleArchiveFile(int fd, Camera* cam, const std::string& file);
+
+    static void sendResponse(int fd, int status, const char* contentType, const std::string& body);
+    static void sendError(int fd, int status, const char* message);
+};
+
+#endif
@@ -0,0 +1,203 @@
+#include "archive_mirror.h"
+#include "aggregator_config.h"
+#include "http_util.h"
+#include "stream_protocol.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#define OFFSET_FILE ".index_offset"
+
+static bool makeDirs(const std::string& path) {
+    for (size_t pos = 1; pos <= path.size(); pos++) {
+        if (pos == path.size() || path[pos] == '/') {
+            std::string part = path.substr(0, pos);
+            if (mkdir(part.c_str(), 0755) != 0 && errno != EEXIST) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+ArchiveMirror::ArchiveMirror(const std::string& name, const std::string& host, int port, const std::string& dir)
+    : name(name), host(host), port(port), dir(dir), running(false), indexOffset(0) {}
+
+ArchiveMirror::~ArchiveMirror() {
+    stop();
+}
+
+void ArchiveMirror::start() {
+    if (!makeDirs(dir)) {
+        printf("[%s] cannot create archive dir %s\n", name.c_str(), dir.c_str());
+        return;
+    }
+    loadOffset();
+    running = true;
+    thread = std::thread(&ArchiveMirror::loop, this);
+}
+
+void ArchiveMirror::stop() {
+    running = false;
+    wake.notify_all();
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+void ArchiveMirror::loop() {
+    while (running) {
+        syncOnce();
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        wake.wait_for(lock, std::chrono::seconds(AGG_INDEX_POLL_SEC), [&] { return !running; });
+    }
+}
+
+// Fetches index lines past indexOffset and downloads each file they name
+void ArchiveMirror::syncOnce() {
+    HttpConnection conn;
+    std::string path = std::string(INDEX_PATH) + "?offset=" + std::to_string(indexOffset);
+    std::string lines;
+    if (!conn.get(host, port, path) || conn.status() != 200 || !conn.readAll(lines)) {
+        return;
+    }
+    conn.close();
+
+    size_t pos = 0;
+    size_t fetched = 0;
+    while (running) {
+        // A line without its newline is still being written; pick it up next poll
+        size_t nl = lines.find('\n', pos);
+        if (nl == std::string::npos) {
+            break;
+        }
+        std::string line = lines.substr(pos, nl - pos);
+
+        // "epoch,size,filename"
+        size_t c1 = line.find(',');
+        size_t c2 = c1 == std::string::npos ? c1 : line.find(',', c1 + 1);
+        if (c2 != std::string::npos) {
+            size_t size = strtoul(line.c_str() + c1 + 1, NULL, 10);
+            std::string filename = line.substr(c2 + 1);
+            if (!download(filename, size)) {
+                break;  // Retry from this line next poll
+            }
+            fetched++;
+        }
+
+        pos = nl + 1;
+        indexOffset += line.size() + 1;
+        saveOffset();
+    }
+
+    if (fetched > 0) {
+        printf("[%s] mirrored %zu images\n", name.c_str(), fetched);
+    }
+}
+
+bool ArchiveMirror::download(const std::string& filename, size_t size) {
+    std::string base = filename.substr(filename.find_last_of('/') + 1);
+    if (base.empty()) {
+        return true;
+    }
+    std::string localPath = dir + "/" + base;
+
+    struct stat st;
+    if (stat(localPath.c_str(), &st) == 0 && (size_t)st.st_size == size) {
+        return true;
+    }
+
+    HttpConnection conn;
+    if (!conn.get(host, port, std::string(DOWNLOAD_PATH) + "?file=" + base)) {
+        return false;
+    }
+    if (conn.status() == 404) {
+        // Already evicted by the camera's retention policy
+        return true;
+    }
+    if (conn.status() != 200) {
+        return false;
+    }
+
+    std::string tmpPath = localPath + ".tmp";
+    FILE* out = fopen(tmpPath.c_str(), "wb");
+    if (!out) {
+        return false;
+    }
+
+    char chunk[16 * 1024];
+    size_t total = 0;
+    ssize_t r;
+    bool ok = true;
+    while ((r = conn.body().read(chunk, sizeof(chunk))) > 0) {
+        if (fwrite(chunk, 1, r, out) != (size_t)r) {
+            ok = false;
+            break;
+        }
+        total += r;
+    }
+    ok = fclose(out) == 0 && ok && total == size;
+
+    // Only complete files ever appear under their real name
+    if (!ok || rename(tmpPath.c_str(), localPath.c_str()) != 0) {
+        remove(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+std::vector<MirroredImage> ArchiveMirror::listImages() {
+    std::vector<MirroredImage> images;
+    DIR* d = opendir(dir.c_str());
+    if (!d) {
+        return images;
+    }
+
+    struct dirent* entry;
+    while ((entry = readdir(d)) != NULL) {
+        std::string fname = entry->d_name;
+        if (fname.size() < 4 || fname.compare(fname.size() - 4, 4, ".jpg") != 0) {
+            continue;
+        }
+        struct stat st;
+        if (stat((dir + "/" + fname).c_str(), &st) == 0) {
+            images.push_back({ fname, (size_t)st.st_size, st.st_mtime });
+        }
+    }
+    closedir(d);
+
+    // Timestamped names sort chronologically
+    std::sort(images.begin(), images.end(),
+              [](const MirroredImage& a, const MirroredImage& b) { return a.name > b.name; });
+    return images;
+}
+
+void ArchiveMirror::loadOffset() {
+    FILE* f = fopen((dir + "/" + OFFSET_FILE).c_str(), "r");
+    if (!f) {
+        indexOffset = 0;
+        return;
+    }
+    unsigned long value = 0;
+    if (fscanf(f, "%lu", &value) == 1) {
+        indexOffset = value;
+    }
+    fclose(f);
+}
+
+void ArchiveMirror::saveOffset() {
+    std::string path = dir + "/" + OFFSET_FILE;
+    std::string tmp = path + ".tmp";
+    FILE* f = fopen(tmp.c_str(), "w");
+    if (!f) {
+        return;
+    }
+    fprintf(f, "%zu\n", indexOffset);
+    if (fclose(f) == 0) {
+        rename(tmp.c_str(), path.c_str());
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef ARCHIVE_MIRROR_H
+#define ARCHIVE_MIRROR_H
+
+#include <atomic>
+#include <condition_variable>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct MirroredImage {
+    std::string name;  // Basename under the camera's archive directory
+    size_t size;
+    time_t mtime;
+};
+
+// Keeps a local copy of one camera's image archive by following its index
+class ArchiveMirror {
+public:
+    ArchiveMirror(const std::string& name, const std::string& host, int port, const std::string& dir);
+    ~ArchiveMirror();
+
+    void start();
+    void stop();
+
+    const std::string& getDir() const { return dir; }
+    std::vector<MirroredImage> listImages();
+
+private:
+    std::string name;
+    std::string host;
+    int port;
+    std::string dir;
+    std::thread thread;
+    std::atomic<bool> running;
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+
+    // Index bytes already mirrored; persisted so restarts only fetch new lines
+    size_t indexOffset;
+
+    void loop();
+    void syncOnce();
+    bool download(const std::string& filename, size_t size);
+    void loadOffset();
+    void saveOffset();
+};
+
+#endif
@@ -0,0 +1,146 @@
+#include "camera_feed.h"
+#include "aggregator_config.h"
+#include "http_util.h"
+#include "stream_protocol.h"
+#include "thumbnail.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+CameraFeed::CameraFeed(const std::string& name, const std::string& host, int port)
+    : name(name), host(host), port(port), running(false), viewers(0), seq(0), thumbnailSeq(0),
+      connected(false), framesReceived(0), bytesReceived(0), reconnects(0) {}
+
+CameraFeed::~CameraFeed() {
+    stop();
+}
+
+void CameraFeed::start() {
+    running = true;
+    ingestThread = std::thread(&CameraFeed::ingestLoop, this);
+}
+
+void CameraFeed::stop() {
+    running = false;
+    frameReady.notify_all();
+    if (ingestThread.joinable()) {
+        ingestThread.join();
+    }
+}
+
+void CameraFeed::ingestLoop() {
+    while (running) {
+        readStream();
+        if (connected) {
+            printf("[%s] stream lost, reconnecting\n", name.c_str());
+        }
+        connected = false;
+        reconnects++;
+        std::this_thread::sleep_for(std::chrono::milliseconds(AGG_RECONNECT_DELAY_MS));
+    }
+}
+
+// One connection's worth of frames; returns when the camera goes away
+bool CameraFeed::readStream() {
+    HttpConnection conn;
+    if (!conn.get(host, port, STREAM_PATH) || conn.status() != 200) {
+        return false;
+    }
+    connected = true;
+    printf("[%s] stream connected (%s:%d)\n", name.c_str(), host.c_str(), port);
+
+    BufferedReader& body = conn.body();
+    std::map<std::string, std::string> headers;
+    while (running) {
+        // Boundary lines have no colon and the blank line after each frame
+        // ends an empty header block; both are skipped here
+        headers.clear();
+        if (!readHeaders(body, headers)) {
+            return false;
+        }
+        auto length = headers.find("content-length");
+        if (length == headers.end()) {
+            continue;
+        }
+
+        long size = atol(length->second.c_str());
+        if (size <= 0 || size > AGG_MAX_FRAME_SIZE) {
+            printf("[%s] bad frame size %ld\n", name.c_str(), size);
+            return false;
+        }
+
+        std::shared_ptr<std::string> frame = std::make_shared<std::string>();
+        frame->resize(size);
+        if (!body.readExact(&(*frame)[0], size)) {
+            return false;
+        }
+
+        framesReceived++;
+        bytesReceived += size;
+        publish(frame);
+    }
+    return true;
+}
+
+void CameraFeed::publish(FramePtr frame) {
+    {
+        std::lock_guard<std::mutex> lock(frameMutex);
+        latest = frame;
+        seq++;
+    }
+    frameReady.notify_all();
+}
+
+FramePtr CameraFeed::waitForFrame(uint64_t& lastSeq, int timeoutMs) {
+    std::unique_lock<std::mutex> lock(frameMutex);
+    frameReady.wait_for(lock, std::chrono::milliseconds(timeoutMs),
+                        [&] { return seq > lastSeq || !running; });
+    if (seq <= lastSeq || !latest) {
+        return nullptr;
+    }
+    // Slow viewers skip straight to the newest frame
+    lastSeq = seq;
+    return latest;
+}
+
+FramePtr CameraFeed::getSnapshot() {
+    std::lock_guard<std::mutex> lock(frameMutex);
+    return latest;
+}
+
+// Built on demand and cached until the next frame arrives
+FramePtr CameraFeed::getThumbnail() {
+    FramePtr frame;
+    uint64_t frameSeq;
+    {
+        std::lock_guard<std::mutex> lock(frameMutex);
+        frame = latest;
+        frameSeq = seq;
+    }
+    if (!frame) {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(thumbMutex);
+    if (thumbnail && thumbnailSeq == frameSeq) {
+        return thumbnail;
+    }
+
+    std::shared_ptr<std::string> thumb = std::make_shared<std::string>();
+    if (!makeThumbnail(*frame, AGG_THUMB_MAX_WIDTH, AGG_THUMB_QUALITY, *thumb)) {
+        return thumbnail;  // Keep serving the last good one
+    }
+    thumbnail = thumb;
+    thumbnailSeq = frameSeq;
+    return thumbnail;
+}
+
+FeedStats CameraFeed::getStats() {
+    FeedStats stats;
+    stats.connected = connected;
+    stats.framesReceived = framesReceived;
+    stats.bytesReceived = bytesReceived;
+    stats.reconnects = reconnects;
+    stats.viewers = viewers;
+    return stats;
+}
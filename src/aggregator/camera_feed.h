@@ -0,0 +1,71 @@
+#ifndef CAMERA_FEED_H
+#define CAMERA_FEED_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+typedef std::shared_ptr<const std::string> FramePtr;
+
+struct FeedStats {
+    bool connected;
+    uint64_t framesReceived;
+    uint64_t bytesReceived;
+    uint32_t reconnects;
+    int viewers;
+};
+
+// Pulls one camera's MJPEG stream once and shares every frame with all viewers
+class CameraFeed {
+public:
+    CameraFeed(const std::string& name, const std::string& host, int port);
+    ~CameraFeed();
+
+    void start();
+    void stop();
+
+    const std::string& getName() const { return name; }
+    const std::string& getHost() const { return host; }
+    int getPort() const { return port; }
+
+    // Blocks until a frame newer than lastSeq arrives (or timeoutMs passes)
+    FramePtr waitForFrame(uint64_t& lastSeq, int timeoutMs);
+    FramePtr getSnapshot();
+    FramePtr getThumbnail();
+    FeedStats getStats();
+
+    void addViewer() { viewers++; }
+    void removeViewer() { viewers--; }
+
+private:
+    std::string name;
+    std::string host;
+    int port;
+    std::thread ingestThread;
+    std::atomic<bool> running;
+    std::atomic<int> viewers;
+
+    std::mutex frameMutex;
+    std::condition_variable frameReady;
+    FramePtr latest;
+    uint64_t seq;
+
+    std::mutex thumbMutex;
+    FramePtr thumbnail;
+    uint64_t thumbnailSeq;
+
+    std::atomic<bool> connected;
+    std::atomic<uint64_t> framesReceived;
+    std::atomic<uint64_t> bytesReceived;
+    std::atomic<uint32_t> reconnects;
+
+    void ingestLoop();
+    bool readStream();
+    void publish(FramePtr frame);
+};
+
+#endif
@@ -0,0 +1,278 @@
+#include "http_util.h"
+#include "aggregator_config.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define READ_BUFFER_SIZE (64 * 1024)
+
+ssize_t SocketSource::read(char* dst, size_t n) {
+    ssize_t r;
+    do {
+        r = recv(fd, dst, n, 0);
+    } while (r < 0 && errno == EINTR);
+    return r;
+}
+
+BufferedReader::BufferedReader(ByteSource* src) : src(src), buf(READ_BUFFER_SIZE), start(0), end(0) {}
+
+bool BufferedReader::fill() {
+    if (start > 0 && start == end) {
+        start = end = 0;
+    }
+    if (end == buf.size()) {
+        // Compact before growing; lines longer than the buffer are rejected
+        if (start == 0) {
+            return false;
+        }
+        memmove(buf.data(), buf.data() + start, end - start);
+        end -= start;
+        start = 0;
+    }
+    ssize_t r = src->read(buf.data() + end, buf.size() - end);
+    if (r <= 0) {
+        return false;
+    }
+    end += r;
+    return true;
+}
+
+ssize_t BufferedReader::read(char* dst, size_t n) {
+    if (start == end) {
+        // Large reads bypass the buffer
+        if (n >= buf.size()) {
+            return src->read(dst, n);
+        }
+        if (!fill()) {
+            return 0;
+        }
+    }
+    size_t take = std::min(n, end - start);
+    memcpy(dst, buf.data() + start, take);
+    start += take;
+    return take;
+}
+
+bool BufferedReader::readLine(std::string& line) {
+    line.clear();
+    while (true) {
+        char* begin = buf.data() + start;
+        char* nl = (char*)memchr(begin, '\n', end - start);
+        if (nl) {
+            line.assign(begin, nl - begin);
+            start += (nl - begin) + 1;
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            return true;
+        }
+        if (!fill()) {
+            return false;
+        }
+    }
+}
+
+bool BufferedReader::readExact(char* dst, size_t n) {
+    while (n > 0) {
+        ssize_t r = read(dst, n);
+        if (r <= 0) {
+            return false;
+        }
+        dst += r;
+        n -= r;
+    }
+    return true;
+}
+
+BodySource::BodySource(BufferedReader* in, bool chunked, long contentLength)
+    : in(in), chunked(chunked), remaining(chunked ? 0 : contentLength), firstChunk(true), done(false) {}
+
+ssize_t BodySource::read(char* dst, size_t n) {
+    if (done) {
+        return 0;
+    }
+
+    if (chunked && remaining == 0) {
+        std::string line;
+        // Every chunk after the first is preceded by the previous one's CRLF
+        if (!firstChunk && !in->readLine(line)) {
+            return -1;
+        }
+        firstChunk = false;
+        if (!in->readLine(line)) {
+            return -1;
+        }
+        remaining = strtol(line.c_str(), nullptr, 16);
+        if (remaining == 0) {
+            done = true;
+            return 0;
+        }
+    }
+
+    if (remaining == 0) {
+        done = true;
+        return 0;
+    }
+
+    size_t want = remaining < 0 ? n : std::min(n, (size_t)remaining);
+    ssize_t r = in->read(dst, want);
+    if (r <= 0) {
+        done = true;
+        return r;
+    }
+    if (remaining > 0) {
+        remaining -= r;
+        if (remaining == 0 && !chunked) {
+            done = true;
+        }
+    }
+    return r;
+}
+
+HttpConnection::HttpConnection() : fd(-1) {}
+
+HttpConnection::~HttpConnection() {
+    close();
+}
+
+bool HttpConnection::get(const std::string& host, int port, const std::string& path) {
+    close();
+    fd = connectTo(host, port, AGG_CONNECT_TIMEOUT_SEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    std::string request = "GET " + path + " HTTP/1.1\r\nHost: " + host + "\r\nConnection: close\r\n\r\n";
+    if (!sendAll(fd, request)) {
+        close();
+        return false;
+    }
+
+    socketSource.reset(new SocketSource(fd));
+    rawReader.reset(new BufferedReader(socketSource.get()));
+
+    std::string statusLine;
+    if (!rawReader->readLine(statusLine) || statusLine.compare(0, 5, "HTTP/") != 0) {
+        close();
+        return false;
+    }
+    size_t sp = statusLine.find(' ');
+    response.status = sp == std::string::npos ? 0 : atoi(statusLine.c_str() + sp + 1);
+
+    if (!readHeaders(*rawReader, response.headers)) {
+        close();
+        return false;
+    }
+
+    bool chunked = toLower(response.headers["transfer-encoding"]).find("chunked") != std::string::npos;
+    long length = response.headers.count("content-length") ? atol(response.headers["content-length"].c_str()) : -1;
+    bodySource.reset(new BodySource(rawReader.get(), chunked, length));
+    bodyReader.reset(new BufferedReader(bodySource.get()));
+    return true;
+}
+
+bool HttpConnection::readAll(std::string& out) {
+    out.clear();
+    char chunk[16 * 1024];
+    ssize_t r;
+    while ((r = bodyReader->read(chunk, sizeof(chunk))) > 0) {
+        out.append(chunk, r);
+    }
+    return r == 0;
+}
+
+void HttpConnection::close() {
+    bodyReader.reset();
+    bodySource.reset();
+    rawReader.reset();
+    socketSource.reset();
+    response = HttpResponse();
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+int connectTo(const std::string& host, int port, int timeoutSec) {
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    struct addrinfo* res = nullptr;
+    std::string portStr = std::to_string(port);
+    if (getaddrinfo(host.c_str(), portStr.c_str(), &hints, &res) != 0) {
+        return -1;
+    }
+
+    int fd = -1;
+    for (struct addrinfo* ai = res; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+
+        struct timeval tv = { timeoutSec, 0 };
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        struct timeval rtv = { AGG_RECV_TIMEOUT_SEC, 0 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &rtv, sizeof(rtv));
+
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            break;
+        }
+        ::close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+bool sendAll(int fd, const void* data, size_t len) {
+    const char* p = (const char*)data;
+    while (len > 0) {
+        ssize_t w = send(fd, p, len, MSG_NOSIGNAL);
+        if (w < 0 && errno == EINTR) {
+            continue;
+        }
+        if (w <= 0) {
+            return false;
+        }
+        p += w;
+        len -= w;
+    }
+    return true;
+}
+
+bool sendAll(int fd, const std::string& data) {
+    return sendAll(fd, data.data(), data.size());
+}
+
+bool readHeaders(BufferedReader& in, std::map<std::string, std::string>& headers) {
+    std::string line;
+    while (in.readLine(line)) {
+        if (line.empty()) {
+            return true;
+        }
+        size_t colon = line.find(':');
+        if (colon == std::string::npos) {
+            continue;
+        }
+        size_t valueStart = line.find_first_not_of(' ', colon + 1);
+        headers[toLower(line.substr(0, colon))] =
+            valueStart == std::string::npos ? "" : line.substr(valueStart);
+    }
+    return false;
+}
+
+std::string toLower(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return std::tolower(c); });
+    return s;
+}
@@ -0,0 +1,88 @@
+#ifndef HTTP_UTIL_H
+#define HTTP_UTIL_H
+
+#include <sys/types.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Anything bytes can be pulled from: a socket, or a decoded HTTP body
+class ByteSource {
+public:
+    virtual ~ByteSource() {}
+    virtual ssize_t read(char* dst, size_t n) = 0;
+};
+
+class SocketSource : public ByteSource {
+public:
+    explicit SocketSource(int fd) : fd(fd) {}
+    ssize_t read(char* dst, size_t n) override;
+
+private:
+    int fd;
+};
+
+class BufferedReader : public ByteSource {
+public:
+    explicit BufferedReader(ByteSource* src);
+
+    ssize_t read(char* dst, size_t n) override;
+    bool readLine(std::string& line);  // Strips the trailing CRLF
+    bool readExact(char* dst, size_t n);
+
+private:
+    ByteSource* src;
+    std::vector<char> buf;
+    size_t start;
+    size_t end;
+    bool fill();
+};
+
+// Decodes a response body framed by chunked encoding, Content-Length, or close
+class BodySource : public ByteSource {
+public:
+    BodySource(BufferedReader* in, bool chunked, long contentLength);
+    ssize_t read(char* dst, size_t n) override;
+
+private:
+    BufferedReader* in;
+    bool chunked;
+    long remaining;  // -1 reads until the connection closes
+    bool firstChunk;
+    bool done;
+};
+
+struct HttpResponse {
+    int status = 0;
+    std::map<std::string, std::string> headers;  // Lower-case names
+};
+
+// One GET request with a streaming body
+class HttpConnection {
+public:
+    HttpConnection();
+    ~HttpConnection();
+
+    bool get(const std::string& host, int port, const std::string& path);
+    int status() const { return response.status; }
+    BufferedReader& body() { return *bodyReader; }
+    bool readAll(std::string& out);
+    void close();
+
+private:
+    int fd;
+    HttpResponse response;
+    std::unique_ptr<SocketSource> socketSource;
+    std::unique_ptr<BufferedReader> rawReader;
+    std::unique_ptr<BodySource> bodySource;
+    std::unique_ptr<BufferedReader> bodyReader;
+};
+
+int connectTo(const std::string& host, int port, int timeoutSec);
+bool sendAll(int fd, const void* data, size_t len);
+bool sendAll(int fd, const std::string& data);
+bool readHeaders(BufferedReader& in, std::map<std::string, std::string>& headers);
+std::string toLower(std::string s);
+
+#endif
@@ -0,0 +1,73 @@
+// Linux aggregator: pulls the live stream and image archive from several
+// cameras and re-serves them to any number of viewers from one place.
+//
+//   aggregator [--port 8080] [--archive ./archive] name=host[:port] ...
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "aggregator_config.h"
+#include "aggregator_server.h"
+#include "archive_mirror.h"
+#include "camera_feed.h"
+
+static void usage(const char* argv0) {
+    fprintf(stderr, "Usage: %s [--port N] [--archive DIR] name=host[:port] ...\n", argv0);
+}
+
+int main(int argc, char** argv) {
+    int port = AGG_DEFAULT_PORT;
+    std::string archiveDir = AGG_DEFAULT_ARCHIVE_DIR;
+    std::vector<Camera> cameras;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--archive") == 0 && i + 1 < argc) {
+            archiveDir = argv[++i];
+        } else {
+            std::string arg = argv[i];
+            size_t eq = arg.find('=');
+            if (eq == std::string::npos || eq == 0 || eq + 1 == arg.size()) {
+                usage(argv[0]);
+                return 1;
+            }
+            std::string name = arg.substr(0, eq);
+            std::string host = arg.substr(eq + 1);
+            int camPort = AGG_CAMERA_PORT;
+            size_t colon = host.find(':');
+            if (colon != std::string::npos) {
+                camPort = atoi(host.c_str() + colon + 1);
+                host = host.substr(0, colon);
+            }
+            cameras.push_back({ new CameraFeed(name, host, camPort),
+                                new ArchiveMirror(name, host, camPort, archiveDir + "/" + name) });
+        }
+    }
+
+    if (cameras.empty()) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // Viewers disconnecting mid-send must not kill the process
+    signal(SIGPIPE, SIG_IGN);
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    AggregatorServer server(port, cameras);
+    if (!server.begin()) {
+        return 1;
+    }
+
+    for (Camera& cam : cameras) {
+        printf("Camera %s at %s:%d\n", cam.feed->getName().c_str(), cam.feed->getHost().c_str(), cam.feed->getPort());
+        cam.feed->start();
+        cam.mirror->start();
+    }
+
+    server.run();
+    return 0;
+}
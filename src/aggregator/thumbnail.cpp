@@ -0,0 +1,100 @@
+#include "thumbnail.h"
+#include <csetjmp>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <jpeglib.h>
+
+struct JpegError {
+    struct jpeg_error_mgr mgr;
+    jmp_buf jump;
+};
+
+// The default handler calls exit(); a corrupt frame must not take down the service
+static void onJpegError(j_common_ptr cinfo) {
+    JpegError* err = (JpegError*)cinfo->err;
+    longjmp(err->jump, 1);
+}
+
+static bool decodeScaled(const std::string& jpeg, int maxWidth, std::vector<unsigned char>& rgb,
+                         int& width, int& height) {
+    struct jpeg_decompress_struct cinfo;
+    JpegError err;
+    cinfo.err = jpeg_std_error(&err.mgr);
+    err.mgr.error_exit = onJpegError;
+    if (setjmp(err.jump)) {
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, (const unsigned char*)jpeg.data(), jpeg.size());
+    jpeg_read_header(&cinfo, TRUE);
+
+    // Least power-of-two reduction that fits within maxWidth (1/8 at most)
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = 1;
+    while (cinfo.scale_denom < 8 && (int)((cinfo.image_width + cinfo.scale_denom - 1) / cinfo.scale_denom) > maxWidth) {
+        cinfo.scale_denom *= 2;
+    }
+    cinfo.out_color_space = JCS_RGB;
+    cinfo.dct_method = JDCT_IFAST;
+
+    jpeg_start_decompress(&cinfo);
+    width = cinfo.output_width;
+    height = cinfo.output_height;
+    rgb.resize((size_t)width * height * 3);
+    while (cinfo.output_scanline < cinfo.output_height) {
+        unsigned char* row = rgb.data() + (size_t)cinfo.output_scanline * width * 3;
+        jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    return true;
+}
+
+static bool encode(const std::vector<unsigned char>& rgb, int width, int height, int quality, std::string& out) {
+    struct jpeg_compress_struct cinfo;
+    JpegError err;
+    unsigned char* mem = nullptr;
+    unsigned long memSize = 0;
+
+    cinfo.err = jpeg_std_error(&err.mgr);
+    err.mgr.error_exit = onJpegError;
+    if (setjmp(err.jump)) {
+        jpeg_destroy_compress(&cinfo);
+        free(mem);
+        return false;
+    }
+
+    jpeg_create_compress(&cinfo);
+    jpeg_mem_dest(&cinfo, &mem, &memSize);
+    cinfo.image_width = width;
+    cinfo.image_height = height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, quality, TRUE);
+
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height) {
+        unsigned char* row = (unsigned char*)rgb.data() + (size_t)cinfo.next_scanline * width * 3;
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+
+    out.assign((const char*)mem, memSize);
+    jpeg_destroy_compress(&cinfo);
+    free(mem);
+    return true;
+}
+
+bool makeThumbnail(const std::string& jpeg, int maxWidth, int quality, std::string& out) {
+    std::vector<unsigned char> rgb;
+    int width = 0;
+    int height = 0;
+    if (!decodeScaled(jpeg, maxWidth, rgb, width, height)) {
+        return false;
+    }
+    return encode(rgb, width, height, quality, out);
+}
@@ -0,0 +1,10 @@
+#ifndef THUMBNAIL_H
+#define THUMBNAIL_H
+
+#include <string>
+
+// Downscaled copy of a JPEG no wider than maxWidth. Uses libjpeg's DCT
+// scaling, so only 1/2, 1/4 or 1/8 of the pixels are ever decoded.
+bool makeThumbnail(const std::string& jpeg, int maxWidth, int quality, std::string& out);
+
+#endif
@@ -2,7 +2,16 @@
 #include "config.h"
 #include <Arduino.h>
 
-CameraModule::CameraModule() : isInitialized(false) {
+// OV2640 pixel array in UXGA mode; the DSP window works in 4-pixel steps
+#define OV2640_FULL_WIDTH  1600
+#define OV2640_FULL_HEIGHT 1200
+#define ROI_MIN_SIZE       64
+
+// set_res_raw() on the OV2640 takes the sensor mode in place of startX
+#define OV2640_MODE_UXGA 0
+#define OV2640_MODE_SVGA 1
+
+CameraModule::CameraModule() : isInitialized(false), frameSize(FRAMESIZE_SVGA), roi() {
     pinMode(FLASH_LED_PIN, OUTPUT);
     digitalWrite(FLASH_LED_PIN, LOW);
 }
@@ -18,7 +27,12 @@ bool CameraModule::init() {
     }
 
     isInitialized = true;
+    frameSize = config.frame_size;
     Serial.println("Camera initialized successfully");
+
+#if ROI_ENABLED
+    setRegionOfInterest(ROI_X, ROI_Y, ROI_WIDTH, ROI_HEIGHT);
+#endif
     return true;
 }
 
@@ -94,3 +108,87 @@ camera_fb_t* CameraModule::captureWithFlash() {
     turnOffFlash();
     return fb;
 }
+
+bool CameraModule::setRegionOfInterest(int x, int y, int width, int height) {
+    if (!isInitialized) {
+        Serial.println("Camera not initialized");
+        return false;
+    }
+
+    sensor_t *s = esp_camera_sensor_get();
+    if (!s || s->id.PID != OV2640_PID) {
+        Serial.println("Region of interest is only supported on the OV2640");
+        return false;
+    }
+
+    // Keep sizes on 8-pixel steps so the binned (halved) window stays 4-aligned
+    x &= ~1;
+    y &= ~1;
+    width &= ~7;
+    height &= ~7;
+    if (x < 0 || y < 0 || width < ROI_MIN_SIZE || height < ROI_MIN_SIZE ||
+        x + width > OV2640_FULL_WIDTH || y + height > OV2640_FULL_HEIGHT) {
+        Serial.println("Invalid region of interest");
+        return false;
+    }
+
+    // The DSP only scales down, and the output must fit the buffers sized at init
+    int maxWidth = resolution[frameSize].width;
+    int maxHeight = resolution[frameSize].height;
+    int outWidth = min(width, maxWidth);
+    int outHeight = outWidth * height / width;
+    if (outHeight > maxHeight) {
+        outHeight = maxHeight;
+        outWidth = outHeight * width / height;
+    }
+    outWidth &= ~3;
+    outHeight &= ~3;
+
+    // Binned SVGA readout runs at twice the frame rate of UXGA; use it
+    // whenever the output would be downscaled by 2x or more anyway
+    int mode = OV2640_MODE_UXGA;
+    int scale = 1;
+    if (outWidth * 2 <= width && outHeight * 2 <= height) {
+        mode = OV2640_MODE_SVGA;
+        scale = 2;
+    }
+
+    int err = s->set_res_raw(s, mode, 0, 0, 0, x / scale, y / scale, width / scale, height / scale,
+                             outWidth, outHeight, false, false);
+    if (err != 0) {
+        Serial.printf("Failed to set region of interest (%d)\n", err);
+        return false;
+    }
+
+    roi.enabled = true;
+    roi.x = x;
+    roi.y = y;
+    roi.width = width;
+    roi.height = height;
+    roi.outputWidth = outWidth;
+    roi.outputHeight = outHeight;
+    Serial.printf("Region of interest %dx%d at (%d,%d) -> %dx%d output (%s readout)\n",
+                  width, height, x, y, outWidth, outHeight, scale == 1 ? "UXGA" : "SVGA");
+    return true;
+}
+
+bool CameraModule::clearRegionOfInterest() {
+    if (!isInitialized) {
+        Serial.println("Camera not initialized");
+        return false;
+    }
+
+    sensor_t *s = esp_camera_sensor_get();
+    if (!s || s->set_framesize(s, frameSize) != 0) {
+        Serial.println("Failed to restore full field of view");
+        return false;
+    }
+
+    roi = RegionOfInterest();
+    Serial.println("Region of interest cleared");
+    return true;
+}
+
+RegionOfInterest CameraModule::getRegionOfInterest() {
+    return roi;
+}
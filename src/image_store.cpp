@@ -0,0 +1,279 @@
+#include "image_store.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_LINE_LENGTH 160  // Longer lines are treated as malformed
+#define READ_CHUNK 128
+
+ImageStore::ImageStore(FileOps* fs, const char* indexPath, const char* journalPath, const char* tempSuffix)
+    : fs(fs), indexPath(indexPath), journalPath(journalPath), tempSuffix(tempSuffix), listener(NULL),
+      recovered(false) {}
+
+bool ImageStore::isCompleteJpeg(const uint8_t* buf, size_t len) {
+    // SOI at the start and EOI at the end; a cut-off write loses the EOI
+    return len >= 4 && buf[0] == 0xFF && buf[1] == 0xD8 && buf[len - 2] == 0xFF && buf[len - 1] == 0xD9;
+}
+
+bool ImageStore::save(const uint8_t* buf, size_t len, const std::string& filename, RetentionClass cls, long epoch) {
+    if (!isCompleteJpeg(buf, len)) {
+        return false;
+    }
+
+    // Appending to a journal from an earlier cut and then removing it would
+    // orphan the interrupted save's temp file
+    if (!recovered) {
+        printf("Image journal not recovered, refusing %s\n", filename.c_str());
+        return false;
+    }
+
+    IndexLine pending = { epoch, len, filename, cls };
+    if (!appendLine(journalPath, pending)) {
+        recovered = clearJournal();
+        return false;
+    }
+
+    std::string tmpPath = filename + tempSuffix;
+    if (!fs->write(tmpPath.c_str(), buf, len) || !commit(filename, len)) {
+        fs->remove(tmpPath.c_str());
+        recovered = clearJournal();
+        return false;
+    }
+
+    IndexLine entry = { epoch, len, filename, -1 };
+    if (!appendLine(indexPath, entry)) {
+        printf("Failed to append %s to index\n", filename.c_str());
+    }
+    if (listener) {
+        listener->imageCommitted(filename, len, cls, epoch);
+    }
+
+    // Only now is the save fully done; recovery has nothing left to finish
+    recovered = clearJournal();
+    return true;
+}
+
+bool ImageStore::clearJournal() {
+    return fs->remove(journalPath) || !fs->exists(journalPath);
+}
+
+// Checks what actually reached the card, not what was handed to write()
+bool ImageStore::verifyFile(const std::string& path, size_t size) {
+    uint8_t head[2];
+    uint8_t tail[2];
+    return size >= 4 && fs->size(path.c_str()) == (long)size &&
+           fs->read(path.c_str(), 0, head, 2) == 2 &&
+           fs->read(path.c_str(), size - 2, tail, 2) == 2 &&
+           head[0] == 0xFF && head[1] == 0xD8 && tail[0] == 0xFF && tail[1] == 0xD9;
+}
+
+// Moves a verified temp file to its final name. A missing temp file with a
+// valid final file means an earlier attempt already got as far as the rename.
+bool ImageStore::commit(const std::string& filename, size_t size) {
+    std::string tmpPath = filename + tempSuffix;
+    if (!fs->exists(tmpPath.c_str())) {
+        return verifyFile(filename, size);
+    }
+
+    if (!verifyFile(tmpPath, size)) {
+        return false;
+    }
+
+    // FAT rename will not replace an existing file
+    fs->remove(filename.c_str());
+    return fs->rename(tmpPath.c_str(), filename.c_str());
+}
+
+// Finishes or discards the saves listed in the journal. A clean shutdown
+// leaves no journal, so the usual boot costs a single exists() check.
+RecoveryStats ImageStore::recover() {
+    RecoveryStats stats = { 0, 0, 0 };
+    if (!fs->exists(journalPath)) {
+        recovered = true;
+        return stats;
+    }
+
+    // A cut during the index append leaves a partial last line
+    repairTail(indexPath);
+
+    IndexLine pending;
+    size_t offset = 0;
+    size_t nextOffset;
+    while (readLine(journalPath, offset, pending, nextOffset)) {
+        offset = nextOffset;
+        std::string tmpPath = pending.filename + tempSuffix;
+
+        if (!commit(pending.filename, pending.size)) {
+            fs->remove(tmpPath.c_str());
+            stats.discarded++;
+            continue;
+        }
+
+        if (!isLastIndexed(pending.filename)) {
+            IndexLine entry = { pending.epoch, pending.size, pending.filename, -1 };
+            appendLine(indexPath, entry);
+            stats.indexed++;
+        }
+
+        // The cut may have come before or after the listener ran; a repeat
+        // only leaves a second retention entry for a file evicted once
+        if (listener && pending.retainClass >= 0) {
+            listener->imageCommitted(pending.filename, pending.size, (RetentionClass)pending.retainClass,
+                                     pending.epoch);
+        }
+        stats.recovered++;
+    }
+
+    recovered = clearJournal();
+    return stats;
+}
+
+// Only the index's last line can be the entry a power cut interrupted
+bool ImageStore::isLastIndexed(const std::string& filename) {
+    std::string tail = "," + filename + "\n";
+    long size = fs->size(indexPath);
+    if (size < (long)tail.size()) {
+        return false;
+    }
+
+    std::string found(tail.size(), '\0');
+    return fs->read(indexPath, size - tail.size(), (uint8_t*)&found[0], tail.size()) == tail.size() &&
+           found == tail;
+}
+
+bool ImageStore::appendLine(const char* path, const IndexLine& line) {
+    if (!repairTail(path)) {
+        return false;
+    }
+
+    char text[MAX_LINE_LENGTH + 32];
+    int n;
+    if (line.retainClass >= 0) {
+        n = snprintf(text, sizeof(text), "%ld,%u,%s,%d\n", line.epoch, (unsigned)line.size,
+                     line.filename.c_str(), line.retainClass);
+    } else {
+        n = snprintf(text, sizeof(text), "%ld,%u,%s\n", line.epoch, (unsigned)line.size, line.filename.c_str());
+    }
+    if (n <= 0 || n > MAX_LINE_LENGTH) {
+        return false;
+    }
+    return fs->append(path, (const uint8_t*)text, n);
+}
+
+// Truncates back to the last newline if the file ends in a partial line
+bool ImageStore::repairTail(const char* path) {
+    long size = fs->size(path);
+    if (size <= 0) {
+        return true;
+    }
+
+    uint8_t last;
+    if (fs->read(path, size - 1, &last, 1) != 1) {
+        return false;
+    }
+    if (last == '\n') {
+        return true;
+    }
+
+    // Scan back a chunk at a time; a torn line is never longer than one line
+    long end = size;
+    while (end > 0) {
+        long start = end > READ_CHUNK ? end - READ_CHUNK : 0;
+        uint8_t buf[READ_CHUNK];
+        size_t n = fs->read(path, start, buf, end - start);
+        if (n != (size_t)(end - start)) {
+            return false;
+        }
+        for (long i = n - 1; i >= 0; i--) {
+            if (buf[i] == '\n') {
+                printf("Dropping torn line at %s:%ld\n", path, start + i + 1);
+                return fs->truncate(path, start + i + 1);
+            }
+        }
+        end = start;
+    }
+    printf("Dropping torn line at %s:0\n", path);
+    return fs->truncate(path, 0);
+}
+
+// false means a clean end of file or a line still being written; nextOffset
+// is then past any malformed lines that were skipped
+bool ImageStore::readLine(const char* path, size_t offset, IndexLine& line, size_t& nextOffset) {
+    nextOffset = offset;
+
+    std::string text;
+    bool overlong = false;
+    size_t pos = offset;
+    uint8_t buf[READ_CHUNK];
+    while (true) {
+        size_t n = fs->read(path, pos, buf, sizeof(buf));
+        if (n == 0) {
+            return false;
+        }
+
+        uint8_t* nl = (uint8_t*)memchr(buf, '\n', n);
+        size_t take = nl ? nl - buf : n;
+        if (!overlong) {
+            text.append((const char*)buf, take);
+            overlong = text.size() > MAX_LINE_LENGTH;
+        }
+        pos += take;
+        if (!nl) {
+            continue;
+        }
+        pos++;  // The newline
+
+        if (!overlong && parseLine(text, line)) {
+            nextOffset = pos;
+            return true;
+        }
+
+        printf("Skipping malformed line at %s:%u\n", path, (unsigned)nextOffset);
+        nextOffset = pos;
+        text.clear();
+        overlong = false;
+    }
+}
+
+static bool isNumber(const std::string& s) {
+    if (s.empty()) {
+        return false;
+    }
+    for (char c : s) {
+        if (c < '0' || c > '9') {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ImageStore::parseLine(const std::string& text, IndexLine& line) {
+    size_t first = text.find(',');
+    size_t second = first == std::string::npos ? first : text.find(',', first + 1);
+    if (second == std::string::npos) {
+        return false;
+    }
+
+    std::string epoch = text.substr(0, first);
+    std::string size = text.substr(first + 1, second - first - 1);
+    std::string rest = text.substr(second + 1);
+
+    line.retainClass = -1;
+    size_t third = rest.find(',');
+    if (third != std::string::npos) {
+        std::string cls = rest.substr(third + 1);
+        if (!isNumber(cls)) {
+            return false;
+        }
+        line.retainClass = atoi(cls.c_str());
+        rest = rest.substr(0, third);
+    }
+
+    if (!isNumber(epoch) || !isNumber(size) || rest.size() < 2 || rest[0] != '/') {
+        return false;
+    }
+    line.epoch = atol(epoch.c_str());
+    line.size = strtoul(size.c_str(), NULL, 10);
+    line.filename = rest;
+    return true;
+}
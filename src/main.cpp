@@ -1,26 +1,69 @@
 #include <Arduino.h>
 #include <WiFi.h>
 #include <time.h>
+#include <atomic>
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
 #include "esp_wifi.h"
 #include "config.h"
 #include "camera_module.h"
 #include "sd_card_module.h"
+#include "time_module.h"
+#include "power_module.h"
+#include "upload_module.h"
+#include "retention_module.h"
+#include "recorder_module.h"
 #include "web_server_module.h"
 
 // Module instances
 CameraModule camera;
 SDCardModule sdCard;
+TimeModule timeModule;
+PowerModule power;
+UploadModule uploader(&sdCard);
+RetentionModule retention(&sdCard, &timeModule);
+RecorderModule recorder(&camera, &sdCard, &timeModule, &retention);
 WebServerModule* webServer = nullptr;
 
 // Timer variables
 int lastCaptureDay = -1;  // Track the day of year we last captured
-int imageCount = 0;
+// Next image number; -1 until sdInitTask has recovered the journal and
+// found it. Claimed with imageCount++ from the loop and httpd workers.
+std::atomic<int> imageCount(-1);
+
+// Boot dependencies: each bit is set once that subsystem is usable
+#define BOOT_CAMERA_READY  BIT0
+#define BOOT_SD_READY      BIT1
+#define BOOT_WIFI_READY    BIT2
+#define BOOT_SERVER_READY  BIT3
+#define BOOT_TIME_READY    BIT4
+#define BOOT_ALL_READY     (BOOT_CAMERA_READY | BOOT_SD_READY | BOOT_WIFI_READY | BOOT_SERVER_READY)
+
+// Milliseconds since power-on at which each boot phase finished
+struct BootTimings {
+    uint32_t cameraReady;
+    uint32_t sdReady;
+    uint32_t indexReady;
+    uint32_t wifiReady;
+    uint32_t serverReady;
+    uint32_t timeReady;
+};
+
+EventGroupHandle_t bootEvents = nullptr;
+BootTimings bootTimings = {};
+bool bootReported = false;
 
 // Function declarations
 bool connectWiFi();
 bool isWiFiConnected();
+void applyWiFiOptimizations();
+void startWebServer();
+void serviceBoot();
+void printBootTimings();
+void cameraInitTask(void* param);
+void sdInitTask(void* param);
+void runDutyCycle();
 void performScheduledCapture();
-void setupTime();
 bool shouldCaptureNow();
 
 void setup() {
@@ -30,68 +73,234 @@ void setup() {
     delay(100);
     Serial.println("\n\nESP32-CAM Plant Monitor Starting...");
 
-    // Initialize camera
+    bootEvents = xEventGroupCreate();
+    power.begin();
+
+    // Before any capture: filenames and the daily-shot hour use local time
+    TimeModule::applyTimezone();
+
+#if !DEEP_SLEEP_MODE
+    // Start WiFi association first; it completes in the background
+    WiFi.mode(WIFI_STA);
+    WiFi.setAutoReconnect(true);
+    WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+#endif
+
+    // Camera and SD bring-up run while WiFi associates. SD init also runs
+    // journal, retention and AVI segment recovery, hence the larger stack.
+    xTaskCreatePinnedToCore(cameraInitTask, "camera_init", 4096, NULL, 2, NULL, 1);
+    xTaskCreatePinnedToCore(sdInitTask, "sd_init", 8192, NULL, 1, NULL, 1);
+
+#if DEEP_SLEEP_MODE
+    runDutyCycle();  // Does not return
+#endif
+
+    Serial.printf("Setup complete after %lu ms, subsystems starting in background\n", millis());
+}
+
+void loop() {
+    serviceBoot();
+
+    // Reconnect handling only applies once the first association succeeded.
+    // The web server keeps its listening socket across reconnects.
+    if ((xEventGroupGetBits(bootEvents) & BOOT_WIFI_READY) && !isWiFiConnected()) {
+        Serial.println("WiFi connection lost! Retrying...");
+        if (connectWiFi() && webServer != nullptr) {
+            webServer->printServerInfo();
+        }
+    }
+
+    // Bounded, incremental eviction; a no-op until SD is ready
+    retention.service();
+
+    delay(10);  // Requests are served by the web server's own tasks
+
+    // Check if it's time for automatic capture (daily at 3pm)
+    if (shouldCaptureNow()) {
+        performScheduledCapture();
+    }
+}
+
+void cameraInitTask(void* param) {
     while (!camera.init()) {
         Serial.println("Camera initialization failed! Retrying...");
         delay(1000);
     }
+    bootTimings.cameraReady = millis();
+    xEventGroupSetBits(bootEvents, BOOT_CAMERA_READY);
+    vTaskDelete(NULL);
+}
 
-    while (!isWiFiConnected()) {
-        connectWiFi();
-        Serial.println("WiFi connection failed! Retrying...");
+void sdInitTask(void* param) {
+    while (!sdCard.init()) {
+        Serial.println("SD Card initialization failed! Retrying...");
         delay(1000);
     }
+    bootTimings.sdReady = millis();
 
-    // Connect to WiFi FIRST (required before web server)
-    if (isWiFiConnected()) {
-        Serial.println("WiFi connected! Initializing web server...");
+    retention.begin();
+
+    // Finish or discard a save cut short by power loss; recovered images
+    // reach their retention queue like new ones. Runs before the scan below
+    // so a recovered image's number is not handed out again.
+    sdCard.setCommitListener(&retention);
+    sdCard.recoverPendingImages();
+
+    // Get the next image number, skipping the directory scan after a timer wake
+    int next;
+    if (power.hasSavedState()) {
+        next = power.getNextImageNumber();
+    } else {
+        next = sdCard.getNextImageNumber();
+        power.setNextImageNumber(next);
+    }
+    // Publishing the count is what lets /capture through
+    imageCount = next;
+    bootTimings.indexReady = millis();
+    Serial.printf("Starting image count: %d\n", next);
+
+#if UPLOAD_ENABLED
+    // Resumes from the persisted cursor and waits for WiFi on its own
+    uploader.begin();
+#endif
+
+#if !DEEP_SLEEP_MODE
+    // Closes any segment left open by a power cut; recording starts on request
+    recorder.begin();
+#endif
+
+    xEventGroupSetBits(bootEvents, BOOT_SD_READY);
+    vTaskDelete(NULL);
+}
 
-        // Setup time synchronization via NTP
-        setupTime();
+void runDutyCycle() {
+    // Capture and save first; WiFi is not touched until the image is on the card
+    EventBits_t bits = xEventGroupWaitBits(bootEvents, BOOT_CAMERA_READY | BOOT_SD_READY,
+                                           pdFALSE, pdTRUE, pdMS_TO_TICKS(5000));
+    if ((bits & (BOOT_CAMERA_READY | BOOT_SD_READY)) == (BOOT_CAMERA_READY | BOOT_SD_READY)) {
+        // Let auto exposure settle on a couple of throwaway frames
+        for (int i = 0; i < SLEEP_WARMUP_FRAMES; i++) {
+            camera.releaseFrameBuffer(camera.captureImage());
+        }
 
-        // Initialize web server ONLY after WiFi is connected
-        webServer = new WebServerModule(&camera, &sdCard, &imageCount);
-        webServer->init();
-        webServer->printServerInfo();
+        camera_fb_t *fb = camera.captureImage();
+        if (fb) {
+            String filename = timeModule.generateImageFilename(imageCount++);
+
+            // The class is journaled with the save, so it is decided up front
+            bool daily = power.claimDailyCapture(&timeModule);
+            if (!sdCard.saveImage(fb, filename, daily ? RETAIN_DAILY : RETAIN_CAPTURE)) {
+                if (daily) {
+                    power.releaseDailyCapture();
+                }
+                Serial.println("Failed to save duty-cycle capture");
+            }
+            camera.releaseFrameBuffer(fb);
+        } else {
+            Serial.println("Duty-cycle capture failed");
+        }
+    } else {
+        Serial.println("Camera or SD not ready, skipping this capture");
     }
+    power.markCaptureDone();
 
-    // Initialize SD card ONLY after WiFi is connected
-    while (!sdCard.init()) {
-        Serial.println("SD Card initialization failed! Retrying...");
-        delay(1000);
+    // Short window for NTP and serving, at default power-save and TX power
+    WiFi.mode(WIFI_STA);
+    WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+    unsigned long connectStart = millis();
+    while (!isWiFiConnected() && millis() - connectStart < SLEEP_WIFI_CONNECT_TIMEOUT_MS) {
+        delay(50);
+    }
+
+    if (isWiFiConnected()) {
+        Serial.printf("WiFi connected in %lu ms\n", millis() - connectStart);
+        timeModule.begin();
+        startWebServer();
+
+        // The web server and uploader run in their own tasks during the window;
+        // retention gets the spare time here, well clear of the capture
+        unsigned long windowStart = millis();
+        while (millis() - windowStart < SLEEP_WIFI_WINDOW_SEC * 1000UL) {
+            retention.service();
+            delay(100);
+        }
+    } else {
+        // Without a window, eviction would never run and the card would fill
+        int evicted = retention.catchUp(SLEEP_RETENTION_MAX_EVICTIONS);
+        Serial.printf("WiFi unavailable, evicted %d files, going back to sleep\n", evicted);
     }
 
-    // Get the next image number
-    imageCount = sdCard.getNextImageNumber();
-    Serial.printf("Starting image count: %d\n", imageCount);
+    WiFi.disconnect(true);
+    WiFi.mode(WIFI_OFF);
 
-    Serial.println("Setup complete!");
+    // Carry the counter, including numbers /capture took during the window,
+    // so the next wake skips the directory scan without reusing any
+    if (imageCount >= 0) {
+        power.setNextImageNumber(imageCount);
+    }
+    power.markWiFiDone();
+    power.sleepUntilNextCapture(&timeModule);
 }
 
-void loop() {
-    // Ensure WiFi is connected
-    if (!isWiFiConnected()) {
-        Serial.println("WiFi connection lost! Retrying...");
-        webServer = nullptr;
-        if (connectWiFi()) {
-            Serial.println("WiFi connected! Initializing web server...");
-            webServer = new WebServerModule(&camera, &sdCard, &imageCount);
-            webServer->init();
-            webServer->printServerInfo();
+void serviceBoot() {
+    EventBits_t bits = xEventGroupGetBits(bootEvents);
+
+    if (!(bits & BOOT_WIFI_READY) && isWiFiConnected()) {
+        bootTimings.wifiReady = millis();
+        Serial.print("WiFi connected! IP Address: ");
+        Serial.println(WiFi.localIP());
+        applyWiFiOptimizations();
+        xEventGroupSetBits(bootEvents, BOOT_WIFI_READY);
+
+        // NTP only needs the network; filenames fall back to the counter until it lands
+        timeModule.begin();
+
+        // The stream does not need the SD card, so serve as soon as WiFi is up
+        startWebServer();
+        bootTimings.serverReady = millis();
+        xEventGroupSetBits(bootEvents, BOOT_SERVER_READY);
+        bits = xEventGroupGetBits(bootEvents);
+    }
+
+    if ((bits & BOOT_WIFI_READY) && !(bits & BOOT_TIME_READY) && timeModule.isSynced()) {
+        bootTimings.timeReady = millis();
+        xEventGroupSetBits(bootEvents, BOOT_TIME_READY);
+
+        struct tm timeinfo;
+        if (timeModule.getTime(&timeinfo)) {
+            Serial.printf("Time synchronized after %lu ms\n", bootTimings.timeReady);
+            Serial.println(&timeinfo, "Current time: %A, %B %d %Y %H:%M:%S");
         }
     }
 
-    // Handle web server requests only if web server is initialized
-    if (webServer != nullptr) {
-        webServer->handleClient();
+    if (!bootReported && (bits & BOOT_ALL_READY) == BOOT_ALL_READY) {
+        bootReported = true;
+        printBootTimings();
     }
+}
 
-    // Check if it's time for automatic capture (daily at 3pm)
-    if (shouldCaptureNow()) {
-        performScheduledCapture();
+void printBootTimings() {
+    Serial.println("Boot phase timings (ms since power-on):");
+    Serial.printf("  Camera ready:  %lu\n", bootTimings.cameraReady);
+    Serial.printf("  SD mounted:    %lu\n", bootTimings.sdReady);
+    Serial.printf("  Image index:   %lu (%lu ms scan)\n", bootTimings.indexReady,
+                  bootTimings.indexReady - bootTimings.sdReady);
+    Serial.printf("  WiFi up:       %lu\n", bootTimings.wifiReady);
+    Serial.printf("  Server ready:  %lu\n", bootTimings.serverReady);
+    if (bootTimings.timeReady) {
+        Serial.printf("  Time synced:   %lu\n", bootTimings.timeReady);
+    } else {
+        Serial.println("  Time synced:   pending");
     }
 }
 
+void startWebServer() {
+    Serial.println("Initializing web server...");
+    webServer = new WebServerModule(&camera, &sdCard, &timeModule, &uploader, &recorder, &retention, &imageCount);
+    webServer->init();
+    webServer->printServerInfo();
+}
+
 bool isWiFiConnected() {
     return WiFi.status() == WL_CONNECTED;
 }
@@ -119,16 +328,7 @@ bool connectWiFi() {
         Serial.println("\nWiFi connected!");
         Serial.print("IP Address: ");
         Serial.println(WiFi.localIP());
-
-        // Optimize WiFi for streaming performance
-        WiFi.setSleep(false);  // Disable WiFi power saving
-        esp_wifi_set_ps(WIFI_PS_NONE);  // No power save mode
-
-        // Set WiFi TX power to maximum for better range/speed
-        WiFi.setTxPower(WIFI_POWER_19_5dBm);
-
-        Serial.println("WiFi optimizations applied");
-
+        applyWiFiOptimizations();
         return true;
     } else {
         Serial.println("\nWiFi connection failed!");
@@ -136,34 +336,27 @@ bool connectWiFi() {
     }
 }
 
-void setupTime() {
-    // Configure NTP time synchronization
-    // Format: timezone offset, daylight offset, ntp server
-    configTime(TIMEZONE_OFFSET * 3600, DAYLIGHT_OFFSET, "pool.ntp.org", "time.nist.gov");
+void applyWiFiOptimizations() {
+    // Optimize WiFi for streaming performance
+    WiFi.setSleep(false);  // Disable WiFi power saving
+    esp_wifi_set_ps(WIFI_PS_NONE);  // No power save mode
 
-    Serial.println("Waiting for NTP time sync...");
-    time_t now = time(nullptr);
-    int attempts = 0;
-    while (now < 24 * 3600 && attempts < 20) {  // Wait until we have a valid time (after 1970)
-        delay(500);
-        Serial.print(".");
-        now = time(nullptr);
-        attempts++;
-    }
-    Serial.println();
+    // Set WiFi TX power to maximum for better range/speed
+    WiFi.setTxPower(WIFI_POWER_19_5dBm);
 
-    struct tm timeinfo;
-    if (getLocalTime(&timeinfo)) {
-        Serial.println("Time synchronized!");
-        Serial.println(&timeinfo, "Current time: %A, %B %d %Y %H:%M:%S");
-    } else {
-        Serial.println("Failed to obtain time");
-    }
+    Serial.println("WiFi optimizations applied");
 }
 
 bool shouldCaptureNow() {
+    // Scheduled captures need both a valid clock and the camera/SD pair
+    EventBits_t bits = xEventGroupGetBits(bootEvents);
+    if ((bits & (BOOT_CAMERA_READY | BOOT_SD_READY | BOOT_TIME_READY)) !=
+        (BOOT_CAMERA_READY | BOOT_SD_READY | BOOT_TIME_READY)) {
+        return false;
+    }
+
     struct tm timeinfo;
-    if (!getLocalTime(&timeinfo)) {
+    if (!timeModule.getTime(&timeinfo)) {
         Serial.println("Failed to get local time");
         return false;
     }
@@ -182,7 +375,7 @@ bool shouldCaptureNow() {
 
 void performScheduledCapture() {
     struct tm timeinfo;
-    if (getLocalTime(&timeinfo)) {
+    if (timeModule.getTime(&timeinfo)) {
         Serial.print("Time for scheduled capture! ");
         Serial.println(&timeinfo, "Time: %A, %B %d %Y %H:%M:%S");
     } else {
@@ -196,18 +389,9 @@ void performScheduledCapture() {
     }
 
     // Generate timestamp-based filename
-    String filename;
-    if (getLocalTime(&timeinfo)) {
-        char timestamp[32];
-        strftime(timestamp, sizeof(timestamp), "%Y%m%d_%H%M%S", &timeinfo);
-        filename = String(IMAGE_PREFIX) + String(timestamp) + String(IMAGE_EXTENSION);
-    } else {
-        // Fallback to counter if time not available
-        filename = String(IMAGE_PREFIX) + String(imageCount) + String(IMAGE_EXTENSION);
-    }
-    imageCount++;
+    String filename = timeModule.generateImageFilename(imageCount++);
 
-    bool success = sdCard.saveImage(fb, filename);
+    bool success = sdCard.saveImage(fb, filename, RETAIN_DAILY);
     camera.releaseFrameBuffer(fb);
 
     if (success) {
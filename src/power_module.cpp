@@ -0,0 +1,145 @@
+#include "power_module.h"
+#include "esp_sleep.h"
+#include "esp_timer.h"
+#include "driver/gpio.h"
+#include "esp_camera.h"
+
+#define SLEEP_STATE_MAGIC 0x504C4E54  // "PLNT"
+
+RTC_DATA_ATTR static SleepState rtcState;
+
+PowerModule::PowerModule() : stateValid(false), captureDoneUs(0), wifiDoneUs(0) {}
+
+bool PowerModule::begin() {
+    // Release the pins held low/high through the last sleep
+    gpio_hold_dis((gpio_num_t)FLASH_LED_PIN);
+    gpio_hold_dis((gpio_num_t)PWDN_GPIO_NUM);
+    gpio_deep_sleep_hold_dis();
+
+    stateValid = (rtcState.magic == SLEEP_STATE_MAGIC);
+    if (!stateValid) {
+        memset(&rtcState, 0, sizeof(rtcState));
+        rtcState.magic = SLEEP_STATE_MAGIC;
+        rtcState.nextImageNumber = -1;
+        rtcState.lastDailyCaptureDay = -1;
+    }
+    rtcState.wakeCount++;
+
+    Serial.printf("Wake #%lu (%s)\n", (unsigned long)rtcState.wakeCount,
+                  isTimerWake() ? "timer" : "power-on/reset");
+    return stateValid;
+}
+
+bool PowerModule::hasSavedState() {
+    // A plain reset also keeps RTC memory, but only a timer wake is known to be current
+    return stateValid && isTimerWake() && rtcState.nextImageNumber >= 0;
+}
+
+bool PowerModule::isTimerWake() {
+    return esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER;
+}
+
+int PowerModule::getNextImageNumber() {
+    return rtcState.nextImageNumber;
+}
+
+void PowerModule::setNextImageNumber(int number) {
+    rtcState.nextImageNumber = number;
+}
+
+// The first capture at or after CAPTURE_HOUR each day is the daily shot
+bool PowerModule::claimDailyCapture(TimeModule* timeModule) {
+    struct tm timeinfo;
+    if (!timeModule->getTime(&timeinfo)) {
+        return false;
+    }
+    if (timeinfo.tm_hour < CAPTURE_HOUR || rtcState.lastDailyCaptureDay == timeinfo.tm_yday) {
+        return false;
+    }
+    rtcState.lastDailyCaptureDay = timeinfo.tm_yday;
+    return true;
+}
+
+// Hands the claim back when the daily shot could not be saved
+void PowerModule::releaseDailyCapture() {
+    rtcState.lastDailyCaptureDay = -1;
+}
+
+void PowerModule::markCaptureDone() {
+    // esp_timer counts from the wake, so this is wake-to-saved latency
+    captureDoneUs = esp_timer_get_time();
+    Serial.printf("Wake-to-saved latency: %llu ms\n", captureDoneUs / 1000);
+}
+
+void PowerModule::markWiFiDone() {
+    wifiDoneUs = esp_timer_get_time();
+}
+
+uint64_t PowerModule::nextSleepDurationUs(TimeModule* timeModule) {
+    const uint64_t intervalSec = SLEEP_CAPTURE_INTERVAL_MIN * 60ULL;
+
+    // Align to wall-clock interval boundaries once the clock is valid. NTP
+    // can step the clock back during the window, leaving only seconds to
+    // the boundary; skip to the next one rather than capture twice.
+    if (timeModule->isSynced()) {
+        time_t now = time(nullptr);
+        uint64_t remaining = intervalSec - ((uint64_t)now % intervalSec);
+        if (remaining < intervalSec / 2) {
+            remaining += intervalSec;
+        }
+        return remaining * 1000000ULL;
+    }
+
+    // Without a clock, sleep the interval minus the time already spent awake
+    uint64_t awakeUs = esp_timer_get_time();
+    uint64_t intervalUs = intervalSec * 1000000ULL;
+    return awakeUs < intervalUs ? intervalUs - awakeUs : intervalUs;
+}
+
+void PowerModule::logAverageCurrent() {
+    uint64_t totalUs = rtcState.captureUs + rtcState.wifiUs + rtcState.sleepUs;
+    if (totalUs == 0) {
+        return;
+    }
+
+    // Charge in mA*us, with the sleep current converted from uA
+    double charge = (double)rtcState.captureUs * SLEEP_CAPTURE_CURRENT_MA +
+                    (double)rtcState.wifiUs * SLEEP_WIFI_CURRENT_MA +
+                    (double)rtcState.sleepUs * SLEEP_DEEP_CURRENT_UA / 1000.0;
+
+    Serial.printf("Duty cycle: capture %llu ms, wifi %llu ms, sleep %llu s over %lu wakes\n",
+                  rtcState.captureUs / 1000, rtcState.wifiUs / 1000,
+                  rtcState.sleepUs / 1000000, (unsigned long)rtcState.wakeCount);
+    Serial.printf("Estimated average current: %.2f mA\n", charge / totalUs);
+}
+
+void PowerModule::sleepUntilNextCapture(TimeModule* timeModule) {
+    uint64_t nowUs = esp_timer_get_time();
+    if (captureDoneUs == 0) {
+        captureDoneUs = nowUs;
+    }
+    if (wifiDoneUs == 0) {
+        wifiDoneUs = nowUs;
+    }
+
+    uint64_t sleepUs = nextSleepDurationUs(timeModule);
+    rtcState.captureUs += captureDoneUs;
+    rtcState.wifiUs += wifiDoneUs - captureDoneUs;
+    rtcState.sleepUs += sleepUs;
+    logAverageCurrent();
+
+    // Power the sensor down and keep the flash LED off while sleeping
+    esp_camera_deinit();
+    pinMode(PWDN_GPIO_NUM, OUTPUT);
+    digitalWrite(PWDN_GPIO_NUM, HIGH);
+    digitalWrite(FLASH_LED_PIN, LOW);
+    gpio_hold_en((gpio_num_t)PWDN_GPIO_NUM);
+    gpio_hold_en((gpio_num_t)FLASH_LED_PIN);
+    gpio_deep_sleep_hold_en();
+
+    Serial.printf("Sleeping for %llu s\n", sleepUs / 1000000);
+    Serial.flush();
+
+    esp_sleep_enable_timer_wakeup(sleepUs);
+    esp_deep_sleep_start();
+}
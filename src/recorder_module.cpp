@@ -0,0 +1,504 @@
+#include "recorder_module.h"
+#include <vector>
+
+// Fixed AVI header: RIFF + hdrl (avih, strl(strh, strf)) + 'movi' list header
+#define AVI_HEADER_SIZE 224
+#define AVI_IDX_ENTRY_SIZE 16
+#define AVIF_HASINDEX 0x10
+#define AVIIF_KEYFRAME 0x10
+
+static void putU16(uint8_t* p, uint16_t v) {
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+}
+
+static void putU32(uint8_t* p, uint32_t v) {
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+    p[3] = (v >> 24) & 0xFF;
+}
+
+static uint32_t getU32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void putFourCC(uint8_t* p, const char* fourcc) {
+    memcpy(p, fourcc, 4);
+}
+
+// idx1 offsets are relative to the 'movi' fourcc at byte 220
+static void buildAviHeader(uint8_t* h, uint16_t width, uint16_t height, uint32_t frames,
+                           uint32_t usPerFrame, uint32_t maxFrameSize, uint32_t moviBytes) {
+    memset(h, 0, AVI_HEADER_SIZE);
+    uint32_t idxChunk = frames ? 8 + frames * AVI_IDX_ENTRY_SIZE : 0;
+
+    putFourCC(h + 0, "RIFF");
+    putU32(h + 4, AVI_HEADER_SIZE - 8 + moviBytes + idxChunk);
+    putFourCC(h + 8, "AVI ");
+
+    putFourCC(h + 12, "LIST");
+    putU32(h + 16, 192);
+    putFourCC(h + 20, "hdrl");
+
+    putFourCC(h + 24, "avih");
+    putU32(h + 28, 56);
+    putU32(h + 32, usPerFrame);
+    putU32(h + 36, (uint32_t)((uint64_t)maxFrameSize * 1000000 / usPerFrame));
+    putU32(h + 44, AVIF_HASINDEX);
+    putU32(h + 48, frames);
+    putU32(h + 56, 1);  // One stream
+    putU32(h + 60, maxFrameSize);
+    putU32(h + 64, width);
+    putU32(h + 68, height);
+
+    putFourCC(h + 88, "LIST");
+    putU32(h + 92, 116);
+    putFourCC(h + 96, "strl");
+
+    putFourCC(h + 100, "strh");
+    putU32(h + 104, 56);
+    putFourCC(h + 108, "vids");
+    putFourCC(h + 112, "MJPG");
+    putU32(h + 128, usPerFrame);  // Scale / rate gives the measured frame rate
+    putU32(h + 132, 1000000);
+    putU32(h + 140, frames);
+    putU32(h + 144, maxFrameSize);
+    putU32(h + 148, 0xFFFFFFFF);
+    putU16(h + 160, width);
+    putU16(h + 162, height);
+
+    putFourCC(h + 164, "strf");
+    putU32(h + 168, 40);
+    putU32(h + 172, 40);
+    putU32(h + 176, width);
+    putU32(h + 180, height);
+    putU16(h + 184, 1);
+    putU16(h + 186, 24);
+    putFourCC(h + 188, "MJPG");
+    putU32(h + 192, (uint32_t)width * height * 3);
+
+    putFourCC(h + 212, "LIST");
+    putU32(h + 216, 4 + moviBytes);
+    putFourCC(h + 220, "movi");
+}
+
+RecorderModule::RecorderModule(CameraModule* cam, SDCardModule* sd, TimeModule* tm, RetentionModule* rm)
+    : camera(cam), sdCard(sd), timeModule(tm), retention(rm), started(false), recording(false),
+      freeFrames(NULL), readyFrames(NULL), statsMutex(NULL), lastOfferMs(0), segmentOpen(false),
+      segmentCounter(0),
+      framesWritten(0), framesDropped(0), segments(0) {}
+
+bool RecorderModule::begin() {
+    statsMutex = xSemaphoreCreateMutex();
+    freeFrames = xQueueCreate(RECORD_QUEUE_DEPTH, sizeof(RecordFrame*));
+    readyFrames = xQueueCreate(RECORD_QUEUE_DEPTH, sizeof(RecordFrame*));
+    if (!statsMutex || !freeFrames || !readyFrames) {
+        Serial.println("Failed to create recorder queues");
+        return false;
+    }
+
+    for (int i = 0; i < RECORD_QUEUE_DEPTH; i++) {
+        frames[i].buf = (uint8_t*)ps_malloc(RECORD_FRAME_BUFFER_SIZE);
+        if (!frames[i].buf) {
+            Serial.println("Failed to allocate recorder frame buffer");
+            return false;
+        }
+        RecordFrame* frame = &frames[i];
+        xQueueSend(freeFrames, &frame, 0);
+    }
+
+    if (!sdCard->ensureDir(RECORD_DIR)) {
+        Serial.println("Failed to create recording directory");
+        return false;
+    }
+    recoverSegments();
+
+    // Capture outranks the writer so a slow SD write only ever drops frames
+    xTaskCreatePinnedToCore(captureTask, "rec_capture", 4096, this, 4, NULL, 1);
+    xTaskCreatePinnedToCore(writerTask, "rec_writer", 4096, this, 2, NULL, 1);
+
+    started = true;
+    return true;
+}
+
+bool RecorderModule::start() {
+    if (!started) {
+        Serial.println("Recorder not initialized");
+        return false;
+    }
+    if (!recording) {
+        Serial.println("Recording started");
+    }
+    recording = true;
+    return true;
+}
+
+void RecorderModule::stop() {
+    if (recording) {
+        Serial.println("Recording stopped");
+    }
+    // The writer drains the queue and closes the segment once idle
+    recording = false;
+}
+
+RecorderStats RecorderModule::getStats() {
+    RecorderStats stats;
+    stats.recording = recording;
+    stats.framesWritten = framesWritten;
+    stats.framesDropped = 0;
+    stats.segments = segments;
+    stats.fps = 0;
+    if (!statsMutex) {
+        return stats;
+    }
+
+    xSemaphoreTake(statsMutex, portMAX_DELAY);
+    stats.framesDropped = framesDropped;
+    if (segmentOpen) {
+        unsigned long elapsed = millis() - segment.startMs;
+        if (elapsed > 0) {
+            stats.fps = segment.frames * 1000.0f / elapsed;
+        }
+        stats.currentSegment = segment.path;
+    }
+    xSemaphoreGive(statsMutex);
+    return stats;
+}
+
+String RecorderModule::nextSegmentPath() {
+    String path;
+    String stamp = timeModule->timestamp();
+    if (stamp.length() > 0) {
+        path = String(RECORD_DIR) + "/rec_" + stamp + ".avi";
+    }
+
+    // Counter fallback until the clock is valid, skipping names already used
+    while (path.length() == 0 || sdCard->exists(path)) {
+        path = String(RECORD_DIR) + "/rec_" + String(segmentCounter++) + ".avi";
+    }
+    return path;
+}
+
+bool RecorderModule::openSegment(uint16_t width, uint16_t height) {
+    String path = nextSegmentPath();
+    segment.avi = sdCard->openFile(path, FILE_WRITE);
+    segment.idx = sdCard->openFile(path + ".idx", FILE_WRITE);
+    if (!segment.avi || !segment.idx) {
+        Serial.println("Failed to open recording segment");
+        segment.avi.close();
+        segment.idx.close();
+        sdCard->removeFile(path);
+        sdCard->removeFile(path + ".idx");
+        return false;
+    }
+
+    // Placeholder header; sizes and counts are filled in when the segment closes
+    uint8_t header[AVI_HEADER_SIZE];
+    buildAviHeader(header, width, height, 0, 1000000 / RECORD_FPS, 0, 0);
+    if (segment.avi.write(header, AVI_HEADER_SIZE) != AVI_HEADER_SIZE) {
+        Serial.println("Failed to write AVI header");
+        segment.avi.close();
+        segment.idx.close();
+        return false;
+    }
+
+    // getStats() copies these from the httpd task
+    xSemaphoreTake(statsMutex, portMAX_DELAY);
+    segment.path = path;
+    segment.frames = 0;
+    segment.moviBytes = 0;
+    segment.maxFrameSize = 0;
+    segment.width = width;
+    segment.height = height;
+    segment.startMs = millis();
+    segmentOpen = true;
+    segments++;
+    xSemaphoreGive(statsMutex);
+
+    Serial.printf("Recording segment %s (%ux%u)\n", path.c_str(), width, height);
+    return true;
+}
+
+bool RecorderModule::writeFrame(const RecordFrame* frame) {
+    uint8_t chunk[8];
+    putFourCC(chunk, "00dc");
+    putU32(chunk + 4, frame->len);
+
+    size_t pad = frame->len & 1;  // RIFF chunks are word aligned
+    bool ok = segment.avi.write(chunk, sizeof(chunk)) == sizeof(chunk) &&
+              segment.avi.write(frame->buf, frame->len) == frame->len;
+    if (ok && pad) {
+        uint8_t zero = 0;
+        ok = segment.avi.write(&zero, 1) == 1;
+    }
+    if (!ok) {
+        return false;
+    }
+
+    // Index entry only after the frame data, so it never points past the file
+    uint8_t entry[AVI_IDX_ENTRY_SIZE];
+    putFourCC(entry, "00dc");
+    putU32(entry + 4, AVIIF_KEYFRAME);
+    putU32(entry + 8, 4 + segment.moviBytes);
+    putU32(entry + 12, frame->len);
+    segment.idx.write(entry, sizeof(entry));
+
+    segment.moviBytes += sizeof(chunk) + frame->len + pad;
+    segment.maxFrameSize = max(segment.maxFrameSize, (uint32_t)frame->len);
+    xSemaphoreTake(statsMutex, portMAX_DELAY);
+    segment.frames++;
+    xSemaphoreGive(statsMutex);
+
+    // Bound what a power cut can lose to the last few frames
+    if (segment.frames % RECORD_SYNC_FRAMES == 0) {
+        segment.avi.flush();
+        segment.idx.flush();
+    }
+    return true;
+}
+
+void RecorderModule::closeSegment() {
+    if (!segmentOpen) {
+        return;
+    }
+    xSemaphoreTake(statsMutex, portMAX_DELAY);
+    segmentOpen = false;
+    xSemaphoreGive(statsMutex);
+
+    String idxPath = segment.path + ".idx";
+    segment.idx.close();
+
+    if (segment.frames == 0) {
+        segment.avi.close();
+        sdCard->removeFile(segment.path);
+        sdCard->removeFile(idxPath);
+        return;
+    }
+
+    unsigned long elapsedMs = millis() - segment.startMs;
+    uint32_t usPerFrame = max((uint32_t)((uint64_t)elapsedMs * 1000 / segment.frames), (uint32_t)1);
+
+    bool ok = finalizeAvi(segment.avi, idxPath, segment.frames, segment.moviBytes,
+                          segment.width, segment.height, usPerFrame, segment.maxFrameSize);
+    segment.avi.close();
+    if (ok) {
+        sdCard->removeFile(idxPath);
+        retention->track(RETAIN_RECORDING, segment.path,
+                         AVI_HEADER_SIZE + segment.moviBytes + 8 + segment.frames * AVI_IDX_ENTRY_SIZE);
+    }
+
+    Serial.printf("Segment %s closed: %lu frames, %lu KB, %.1f fps\n", segment.path.c_str(),
+                  (unsigned long)segment.frames, (unsigned long)(segment.moviBytes / 1024),
+                  1000000.0f / usPerFrame);
+}
+
+bool RecorderModule::finalizeAvi(File& avi, const String& idxPath, uint32_t entries, uint32_t moviBytes,
+                                 uint16_t width, uint16_t height, uint32_t usPerFrame, uint32_t maxFrameSize) {
+    // idx1 goes right after the last complete frame, overwriting any partial one
+    if (!avi.seek(AVI_HEADER_SIZE + moviBytes)) {
+        return false;
+    }
+
+    uint8_t chunk[8];
+    putFourCC(chunk, "idx1");
+    putU32(chunk + 4, entries * AVI_IDX_ENTRY_SIZE);
+    avi.write(chunk, sizeof(chunk));
+
+    File idx = sdCard->openFile(idxPath, FILE_READ);
+    if (!idx) {
+        Serial.printf("Missing index for %s\n", idxPath.c_str());
+        return false;
+    }
+
+    uint8_t buf[512];
+    size_t remaining = entries * AVI_IDX_ENTRY_SIZE;
+    while (remaining > 0) {
+        int n = idx.read(buf, min(sizeof(buf), remaining));
+        if (n <= 0 || avi.write(buf, n) != (size_t)n) {
+            break;
+        }
+        remaining -= n;
+    }
+    idx.close();
+    if (remaining != 0) {
+        Serial.printf("Failed to copy index into %s\n", idxPath.c_str());
+        return false;
+    }
+
+    uint8_t header[AVI_HEADER_SIZE];
+    buildAviHeader(header, width, height, entries, usPerFrame, maxFrameSize, moviBytes);
+    avi.seek(0);
+    return avi.write(header, AVI_HEADER_SIZE) == AVI_HEADER_SIZE;
+}
+
+// Segments cut off by a power loss still have their sidecar index; close them
+// using the frames that reached the card. Only RECORD_DIR is scanned.
+void RecorderModule::recoverSegments() {
+    std::vector<String> pending;
+    File dir = sdCard->openFile(RECORD_DIR);
+    if (!dir || !dir.isDirectory()) {
+        return;
+    }
+    File file = dir.openNextFile();
+    while (file) {
+        String path = String(file.path());
+        if (path.endsWith(".avi.idx")) {
+            pending.push_back(path);
+        }
+        file = dir.openNextFile();
+    }
+    dir.close();
+
+    for (const String& idxPath : pending) {
+        String aviPath = idxPath.substring(0, idxPath.length() - 4);
+        File avi = sdCard->openFile(aviPath, "r+");
+        File idx = sdCard->openFile(idxPath, FILE_READ);
+
+        uint8_t header[AVI_HEADER_SIZE];
+        if (!avi || !idx || avi.read(header, AVI_HEADER_SIZE) != AVI_HEADER_SIZE) {
+            avi.close();
+            idx.close();
+            sdCard->removeFile(aviPath);
+            sdCard->removeFile(idxPath);
+            continue;
+        }
+
+        // Keep entries whose frame data is fully on the card
+        size_t aviSize = avi.size();
+        uint32_t entries = 0;
+        uint32_t moviBytes = 0;
+        uint32_t maxFrameSize = 0;
+        uint8_t entry[AVI_IDX_ENTRY_SIZE];
+        while (idx.read(entry, sizeof(entry)) == sizeof(entry)) {
+            uint32_t len = getU32(entry + 12);
+            uint32_t end = getU32(entry + 8) - 4 + 8 + len + (len & 1);
+            if (AVI_HEADER_SIZE + end > aviSize) {
+                break;
+            }
+            moviBytes = end;
+            maxFrameSize = max(maxFrameSize, len);
+            entries++;
+        }
+        idx.close();
+
+        if (entries == 0) {
+            avi.close();
+            sdCard->removeFile(aviPath);
+            sdCard->removeFile(idxPath);
+            continue;
+        }
+
+        bool ok = finalizeAvi(avi, idxPath, entries, moviBytes, getU32(header + 64),
+                              getU32(header + 68), 1000000 / RECORD_FPS, maxFrameSize);
+        avi.close();
+        if (ok) {
+            sdCard->removeFile(idxPath);
+            retention->track(RETAIN_RECORDING, aviPath,
+                             AVI_HEADER_SIZE + moviBytes + 8 + entries * AVI_IDX_ENTRY_SIZE);
+            Serial.printf("Recovered %s (%lu frames)\n", aviPath.c_str(), (unsigned long)entries);
+        }
+    }
+}
+
+// Stream workers and the capture task can both drop frames
+void RecorderModule::countDropped() {
+    xSemaphoreTake(statsMutex, portMAX_DELAY);
+    framesDropped++;
+    xSemaphoreGive(statsMutex);
+}
+
+// Copies a frame into a free slot for the writer; never blocks the caller
+bool RecorderModule::enqueueFrame(const camera_fb_t* fb) {
+    RecordFrame* frame;
+    if (fb->format != PIXFORMAT_JPEG || fb->len > RECORD_FRAME_BUFFER_SIZE ||
+        xQueueReceive(freeFrames, &frame, 0) != pdTRUE) {
+        // Writer is behind (or the frame is unusable): drop it
+        countDropped();
+        return false;
+    }
+
+    memcpy(frame->buf, fb->buf, fb->len);
+    frame->len = fb->len;
+    frame->width = fb->width;
+    frame->height = fb->height;
+    xQueueSend(readyFrames, &frame, 0);
+    return true;
+}
+
+// With CAMERA_GRAB_LATEST and two frame buffers, every frame the recorder
+// took for itself was one a viewer never got. While a stream is running,
+// the recorder copies the viewers' frames instead (one PSRAM memcpy per
+// frame on the stream worker) and records at the stream's rate.
+void RecorderModule::offerFrame(const camera_fb_t* fb) {
+    if (!started || !recording || !fb) {
+        return;
+    }
+    lastOfferMs = millis();
+    enqueueFrame(fb);
+}
+
+// Grabs frames at RECORD_FPS only while no stream is feeding the recorder
+void RecorderModule::captureTask(void* param) {
+    RecorderModule* self = (RecorderModule*)param;
+    const TickType_t period = pdMS_TO_TICKS(1000 / RECORD_FPS);
+    TickType_t lastWake = xTaskGetTickCount();
+
+    while (true) {
+        if (!self->recording) {
+            delay(100);
+            lastWake = xTaskGetTickCount();
+            continue;
+        }
+        vTaskDelayUntil(&lastWake, period);
+
+        if (millis() - self->lastOfferMs < 2 * 1000UL / RECORD_FPS) {
+            continue;
+        }
+
+        camera_fb_t *fb = self->camera->captureImage();
+        if (!fb) {
+            continue;
+        }
+        self->enqueueFrame(fb);
+        self->camera->releaseFrameBuffer(fb);
+    }
+}
+
+void RecorderModule::writerTask(void* param) {
+    RecorderModule* self = (RecorderModule*)param;
+
+    while (true) {
+        RecordFrame* frame;
+        if (xQueueReceive(self->readyFrames, &frame, pdMS_TO_TICKS(200)) != pdTRUE) {
+            if (!self->recording) {
+                self->closeSegment();
+            }
+            continue;
+        }
+
+        // Rotate on duration, size, or a resolution change (e.g. a new ROI)
+        if (self->segmentOpen &&
+            (millis() - self->segment.startMs >= RECORD_SEGMENT_SECONDS * 1000UL ||
+             self->segment.moviBytes + frame->len + 8 > RECORD_SEGMENT_MAX_BYTES ||
+             frame->width != self->segment.width || frame->height != self->segment.height)) {
+            self->closeSegment();
+        }
+
+        if (!self->segmentOpen) {
+            self->openSegment(frame->width, frame->height);
+        }
+
+        if (self->segmentOpen && self->writeFrame(frame)) {
+            self->framesWritten++;
+        } else {
+            // Most likely a full card; keep what was recorded and stop
+            Serial.println("Recording write failed, stopping");
+            self->countDropped();
+            self->closeSegment();
+            self->recording = false;
+        }
+
+        xQueueSend(self->freeFrames, &frame, 0);
+    }
+}
@@ -0,0 +1,217 @@
+#include "retention_module.h"
+
+#define MB (1024ULL * 1024ULL)
+#define SECONDS_PER_DAY 86400
+
+RetentionModule::RetentionModule(SDCardModule* sd, TimeModule* tm)
+    : sdCard(sd), timeModule(tm), started(false), queueMutex(NULL), statsMutex(NULL), lastServiceMs(0),
+      freeBytes(0), underPressure(false), warnedNothingToEvict(false), evicted(0) {
+    queues[0] = { "capture", RETENTION_CAPTURE_MAX_AGE_DAYS, 0, 0, 0, IndexEntry(), false };
+    queues[1] = { "recording", RETENTION_RECORDING_MAX_AGE_DAYS, 0, 0, 0, IndexEntry(), false };
+}
+
+bool RetentionModule::begin() {
+    if (!sdCard->ensureDir(RETENTION_DIR)) {
+        Serial.println("Failed to create retention directory");
+        return false;
+    }
+
+    queueMutex = xSemaphoreCreateMutex();
+    statsMutex = xSemaphoreCreateMutex();
+    // "offset[,stamp]"
+    for (int i = 0; i < 2; i++) {
+        String state = sdCard->readStateFile(headPath(i));
+        int comma = state.indexOf(',');
+        queues[i].headOffset = (size_t)state.toInt();
+        queues[i].headStamp = comma > 0 ? (time_t)state.substring(comma + 1).toInt() : 0;
+    }
+
+    freeBytes = sdCard->freeBytes();
+    started = true;
+    Serial.printf("Retention: %llu MB free (evicting below %d MB)\n", freeBytes / MB, RETENTION_LOW_FREE_MB);
+    return true;
+}
+
+String RetentionModule::queuePath(int i) {
+    return String(RETENTION_DIR) + "/" + queues[i].name + ".q";
+}
+
+String RetentionModule::headPath(int i) {
+    return String(RETENTION_DIR) + "/" + queues[i].name + ".head";
+}
+
+void RetentionModule::track(RetentionClass cls, const String& path, size_t size, time_t epoch) {
+    if (!started || cls == RETAIN_DAILY) {
+        return;
+    }
+
+    int i = (cls == RETAIN_CAPTURE) ? 0 : 1;
+    xSemaphoreTake(queueMutex, portMAX_DELAY);
+    if (!sdCard->appendIndexEntry(queuePath(i), path, size, epoch)) {
+        Serial.printf("Retention: failed to track %s\n", path.c_str());
+    }
+    xSemaphoreGive(queueMutex);
+}
+
+// Every committed image, including ones finished by journal recovery
+void RetentionModule::imageCommitted(const std::string& filename, size_t size, RetentionClass cls, long epoch) {
+    track(cls, String(filename.c_str()), size, (time_t)epoch);
+}
+
+void RetentionModule::saveHead(int i) {
+    RetentionQueue& q = queues[i];
+    String state(q.headOffset);
+    if (q.headStamp) {
+        state += "," + String((long)q.headStamp);
+    }
+    sdCard->writeStateFile(headPath(i), state);
+}
+
+bool RetentionModule::loadHead(int i) {
+    RetentionQueue& q = queues[i];
+    if (q.hasHead) {
+        return true;
+    }
+
+    xSemaphoreTake(queueMutex, portMAX_DELAY);
+    q.hasHead = sdCard->readIndexEntry(queuePath(i), q.headOffset, q.head, q.nextOffset);
+
+    // Drained queue: drop the file so queues never grow without bound. The
+    // head is reset first: a cut before the remove only replays entries
+    // already evicted, while a stale offset would hide new ones.
+    if (!q.hasHead && q.headOffset > 0) {
+        q.headOffset = 0;
+        q.headStamp = 0;
+        saveHead(i);
+        sdCard->removeFile(queuePath(i));
+    }
+    xSemaphoreGive(queueMutex);
+    return q.hasHead;
+}
+
+// Only queue heads are ever inspected, so each step is constant time
+int RetentionModule::pickVictim() {
+    int victim = -1;
+
+    if (underPressure) {
+        // Oldest head across classes; entries saved before NTP sync sort first
+        for (int i = 0; i < 2; i++) {
+            if (loadHead(i) && (victim < 0 || queues[i].head.epoch < queues[victim].head.epoch)) {
+                victim = i;
+            }
+        }
+        return victim;
+    }
+
+    if (!timeModule->isSynced()) {
+        return -1;
+    }
+
+    time_t now = time(nullptr);
+    for (int i = 0; i < 2; i++) {
+        RetentionQueue& q = queues[i];
+        if (q.maxAgeDays == 0 || !loadHead(i)) {
+            continue;
+        }
+
+        // A head saved before NTP sync has no usable age; it ages from the
+        // first synced look at it instead of blocking the queue behind it
+        time_t epoch = q.head.epoch;
+        if (!TimeModule::isValidEpoch(epoch)) {
+            if (!q.headStamp) {
+                q.headStamp = now;
+                saveHead(i);
+            }
+            epoch = q.headStamp;
+        }
+        if (now - epoch > (time_t)q.maxAgeDays * SECONDS_PER_DAY) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void RetentionModule::evictHead(int i) {
+    RetentionQueue& q = queues[i];
+
+    // A file that is already gone still counts; only the cursor matters
+    sdCard->removeFile(q.head.filename);
+    q.headOffset = q.nextOffset;
+    q.headStamp = 0;
+    q.hasHead = false;
+    saveHead(i);
+
+    // getStats() copies the String from the httpd task
+    xSemaphoreTake(statsMutex, portMAX_DELAY);
+    evicted++;
+    lastEvicted = q.head.filename;
+    xSemaphoreGive(statsMutex);
+    freeBytes += q.head.size;
+    Serial.printf("Retention: evicted %s (%s, %s)\n", q.head.filename.c_str(), q.name,
+                  underPressure ? "low space" : "max age");
+}
+
+// Does at most one deletion per RETENTION_TICK_MS so it never stalls a capture
+void RetentionModule::service() {
+    if (!started || millis() - lastServiceMs < RETENTION_TICK_MS) {
+        return;
+    }
+    lastServiceMs = millis();
+    step();
+}
+
+// Unthrottled eviction for when nothing else is running, e.g. a deep-sleep
+// wake without WiFi that would otherwise never get a service() tick
+int RetentionModule::catchUp(int maxEvictions) {
+    if (!started) {
+        return 0;
+    }
+
+    int count = 0;
+    while (count < maxEvictions && step()) {
+        count++;
+    }
+    lastServiceMs = millis();
+    return count;
+}
+
+// One watermark check and at most one eviction; returns true if a file went
+bool RetentionModule::step() {
+    freeBytes = sdCard->freeBytes();
+    if (freeBytes < RETENTION_LOW_FREE_MB * MB) {
+        if (!underPressure) {
+            Serial.printf("Retention: %llu MB free, evicting oldest files\n", freeBytes / MB);
+        }
+        underPressure = true;
+    } else if (freeBytes >= RETENTION_HIGH_FREE_MB * MB) {
+        underPressure = false;
+        warnedNothingToEvict = false;
+    }
+
+    int victim = pickVictim();
+    if (victim >= 0) {
+        evictHead(victim);
+        return true;
+    }
+    if (underPressure && !warnedNothingToEvict) {
+        Serial.println("Retention: card is low on space but nothing is evictable");
+        warnedNothingToEvict = true;
+    }
+    return false;
+}
+
+RetentionStats RetentionModule::getStats() {
+    RetentionStats stats;
+    stats.freeBytes = freeBytes;
+    stats.underPressure = underPressure;
+    if (!statsMutex) {
+        stats.evicted = 0;
+        return stats;
+    }
+
+    xSemaphoreTake(statsMutex, portMAX_DELAY);
+    stats.evicted = evicted;
+    stats.lastEvicted = lastEvicted;
+    xSemaphoreGive(statsMutex);
+    return stats;
+}
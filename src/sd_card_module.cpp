@@ -1,8 +1,90 @@
 #include "sd_card_module.h"
 #include "config.h"
 #include <Arduino.h>
+#include <unistd.h>
 
-SDCardModule::SDCardModule() : isInitialized(false) {}
+SdFileOps::SdFileOps() : mutex(NULL) {}
+
+void SdFileOps::begin() {
+    if (!mutex) {
+        mutex = xSemaphoreCreateMutex();
+    }
+}
+
+bool SdFileOps::exists(const char* path) {
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    bool found = SD_MMC.exists(path);
+    xSemaphoreGive(mutex);
+    return found;
+}
+
+long SdFileOps::size(const char* path) {
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    File file = SD_MMC.open(path, FILE_READ);
+    long size = file ? (long)file.size() : -1;
+    file.close();
+    xSemaphoreGive(mutex);
+    return size;
+}
+
+size_t SdFileOps::read(const char* path, size_t offset, uint8_t* buf, size_t len) {
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    size_t n = 0;
+    File file = SD_MMC.open(path, FILE_READ);
+    if (file && offset < file.size() && file.seek(offset)) {
+        int r = file.read(buf, len);
+        n = r > 0 ? r : 0;
+    }
+    file.close();
+    xSemaphoreGive(mutex);
+    return n;
+}
+
+bool SdFileOps::write(const char* path, const uint8_t* data, size_t len) {
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    File file = SD_MMC.open(path, FILE_WRITE);
+    bool ok = file && file.write(data, len) == len;
+    file.close();
+    xSemaphoreGive(mutex);
+    return ok;
+}
+
+bool SdFileOps::append(const char* path, const uint8_t* data, size_t len) {
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    File file = SD_MMC.open(path, FILE_APPEND);
+    bool ok = file && file.write(data, len) == len;
+    file.close();
+    xSemaphoreGive(mutex);
+    return ok;
+}
+
+bool SdFileOps::truncate(const char* path, size_t len) {
+    // Arduino's File has no truncate; the FATFS VFS does (IDF 5.x)
+    String fullPath = String(SD_MOUNT_POINT) + path;
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    bool ok = ::truncate(fullPath.c_str(), len) == 0;
+    xSemaphoreGive(mutex);
+    return ok;
+}
+
+bool SdFileOps::rename(const char* from, const char* to) {
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    bool ok = SD_MMC.rename(from, to);
+    xSemaphoreGive(mutex);
+    return ok;
+}
+
+bool SdFileOps::remove(const char* path) {
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    bool ok = SD_MMC.remove(path);
+    xSemaphoreGive(mutex);
+    return ok;
+}
+
+SDCardModule::SDCardModule()
+    : isInitialized(false), bootRecoveryDone(false), indexCounted(false), indexEntryCount(0),
+      saveMutex(NULL),
+      store(&fileOps, IMAGE_INDEX_FILE, IMAGE_JOURNAL_FILE, IMAGE_TEMP_EXTENSION) {}
 
 bool SDCardModule::init() {
     if (!SD_MMC.begin(SD_MOUNT_POINT, true)) { // true = 1-bit mode
@@ -17,6 +99,10 @@ bool SDCardModule::init() {
     }
 
     printCardInfo();
+    fileOps.begin();
+    if (!saveMutex) {
+        saveMutex = xSemaphoreCreateMutex();
+    }
     isInitialized = true;
     return true;
 }
@@ -42,27 +128,37 @@ void SDCardModule::printCardInfo() {
     Serial.printf("SD Card Used: %lluMB\n", usedSize);
 }
 
-bool SDCardModule::saveImage(camera_fb_t* fb, const String& filename) {
+bool SDCardModule::saveImage(camera_fb_t* fb, const String& filename, RetentionClass cls) {
     if (!isInitialized) {
         Serial.println("SD Card not initialized");
         return false;
     }
 
-    if (!fb) {
+    if (!fb || !ImageStore::isCompleteJpeg(fb->buf, fb->len)) {
         Serial.println("Invalid frame buffer");
         return false;
     }
 
-    File file = SD_MMC.open(filename, FILE_WRITE);
-    if (!file) {
-        Serial.println("Failed to open file for writing");
+    // One save at a time keeps the journal down to a single pending entry
+    xSemaphoreTake(saveMutex, portMAX_DELAY);
+    if (!bootRecoveryDone) {
+        // Before recovery the journal may still hold an interrupted save, and
+        // without the listener the image would never reach retention
+        xSemaphoreGive(saveMutex);
+        Serial.println("Image journal not recovered yet");
         return false;
     }
+    if (!store.isRecovered()) {
+        // An earlier save could not remove its journal entry
+        recoverLocked();
+    }
+    bool saved = store.save(fb->buf, fb->len, filename.c_str(), cls, (long)time(nullptr));
+    if (saved && indexCounted) {
+        indexEntryCount++;
+    }
+    xSemaphoreGive(saveMutex);
 
-    size_t written = file.write(fb->buf, fb->len);
-    file.close();
-
-    if (written != fb->len) {
+    if (!saved) {
         Serial.println("Failed to write complete image");
         return false;
     }
@@ -71,6 +167,35 @@ bool SDCardModule::saveImage(camera_fb_t* fb, const String& filename) {
     return true;
 }
 
+void SDCardModule::setCommitListener(ImageCommitListener* listener) {
+    store.setListener(listener);
+}
+
+// Runs once retention is up, so recovered images are tracked like new ones.
+// Saves are refused until this has run.
+void SDCardModule::recoverPendingImages() {
+    if (!isInitialized) {
+        return;
+    }
+
+    xSemaphoreTake(saveMutex, portMAX_DELAY);
+    recoverLocked();
+    bootRecoveryDone = true;
+    xSemaphoreGive(saveMutex);
+}
+
+// Caller holds saveMutex
+void SDCardModule::recoverLocked() {
+    RecoveryStats stats = store.recover();
+    if (indexCounted) {
+        indexEntryCount += stats.indexed;
+    }
+
+    if (stats.recovered || stats.discarded) {
+        Serial.printf("Image journal: %d recovered, %d discarded\n", stats.recovered, stats.discarded);
+    }
+}
+
 std::vector<ImageInfo> SDCardModule::listImages() {
     std::vector<ImageInfo> images;
 
@@ -102,13 +227,36 @@ std::vector<ImageInfo> SDCardModule::listImages() {
     return images;
 }
 
-File SDCardModule::openFile(const String& filename) {
+File SDCardModule::openFile(const String& filename, const char* mode) {
     if (!isInitialized) {
         Serial.println("SD Card not initialized");
         return File();
     }
 
-    return SD_MMC.open(filename, FILE_READ);
+    return SD_MMC.open(filename, mode);
+}
+
+bool SDCardModule::exists(const String& path) {
+    return isInitialized && SD_MMC.exists(path);
+}
+
+bool SDCardModule::removeFile(const String& path) {
+    return isInitialized && SD_MMC.remove(path);
+}
+
+uint64_t SDCardModule::freeBytes() {
+    if (!isInitialized) {
+        return 0;
+    }
+    // FATFS caches the free cluster count, so this is cheap after the first call
+    return SD_MMC.totalBytes() - SD_MMC.usedBytes();
+}
+
+bool SDCardModule::ensureDir(const String& path) {
+    if (!isInitialized) {
+        return false;
+    }
+    return SD_MMC.exists(path) || SD_MMC.mkdir(path);
 }
 
 int SDCardModule::getNextImageNumber() {
@@ -139,3 +287,104 @@ int SDCardModule::getNextImageNumber() {
 
     return maxNum;
 }
+
+bool SDCardModule::appendIndexEntry(const String& path, const String& filename, size_t size, time_t epoch) {
+    if (!isInitialized) {
+        return false;
+    }
+
+    IndexLine line = { (long)(epoch ? epoch : time(nullptr)), size, filename.c_str(), -1 };
+    return store.appendLine(path.c_str(), line);
+}
+
+// Counts the lines readIndexEntry() would return, so a reader that has
+// consumed them all sees zero left even if some lines were malformed
+size_t SDCardModule::countIndexEntries() {
+    size_t count = 0;
+    size_t offset = 0;
+    size_t nextOffset;
+    IndexLine line;
+    while (store.readLine(IMAGE_INDEX_FILE, offset, line, nextOffset)) {
+        count++;
+        offset = nextOffset;
+    }
+    return count;
+}
+
+bool SDCardModule::readIndexEntry(size_t offset, IndexEntry& entry, size_t& nextOffset) {
+    return readIndexEntry(IMAGE_INDEX_FILE, offset, entry, nextOffset);
+}
+
+bool SDCardModule::readIndexEntry(const String& path, size_t offset, IndexEntry& entry, size_t& nextOffset) {
+    nextOffset = offset;
+    if (!isInitialized) {
+        return false;
+    }
+
+    IndexLine line;
+    if (!store.readLine(path.c_str(), offset, line, nextOffset)) {
+        return false;
+    }
+    entry.epoch = (time_t)line.epoch;
+    entry.size = line.size;
+    entry.filename = line.filename.c_str();
+    return true;
+}
+
+// The index only grows, so reading it at boot would put an O(N) scan on
+// every wake. It is counted on first use instead, then kept up by saves.
+size_t SDCardModule::getIndexEntryCount() {
+    if (!isInitialized) {
+        return 0;
+    }
+
+    xSemaphoreTake(saveMutex, portMAX_DELAY);
+    if (!indexCounted) {
+        indexEntryCount = countIndexEntries();
+        indexCounted = true;
+        Serial.printf("Image index: %u entries\n", indexEntryCount);
+    }
+    size_t count = indexEntryCount;
+    xSemaphoreGive(saveMutex);
+    return count;
+}
+
+bool SDCardModule::writeStateFile(const String& path, const String& contents) {
+    if (!isInitialized) {
+        return false;
+    }
+
+    String tmpPath = path + ".tmp";
+    File file = SD_MMC.open(tmpPath, FILE_WRITE);
+    if (!file) {
+        return false;
+    }
+    size_t written = file.print(contents);
+    file.close();
+    if (written != contents.length()) {
+        return false;
+    }
+
+    // FAT rename will not replace an existing file
+    SD_MMC.remove(path);
+    return SD_MMC.rename(tmpPath, path);
+}
+
+String SDCardModule::readStateFile(const String& path) {
+    if (!isInitialized) {
+        return String();
+    }
+
+    // Fall back to the temp copy if power was lost between remove and rename
+    File file = SD_MMC.open(path, FILE_READ);
+    if (!file) {
+        file = SD_MMC.open(path + ".tmp", FILE_READ);
+    }
+    if (!file) {
+        return String();
+    }
+
+    String contents = file.readString();
+    file.close();
+    return contents;
+}
@@ -0,0 +1,71 @@
+#include "time_module.h"
+#include "config.h"
+
+// Any epoch earlier than this means SNTP has not set the clock yet
+#define MIN_VALID_EPOCH 1609459200  // 2021-01-01
+
+TimeModule::TimeModule() : started(false) {}
+
+// The RTC keeps UTC across deep sleep, but TZ is only set by configTime().
+// This sets the same POSIX TZ string so local time is right from the first
+// capture of a wake, before WiFi and SNTP are started.
+void TimeModule::applyTimezone() {
+    long offset = -TIMEZONE_OFFSET * 3600L;  // POSIX offsets are positive west of UTC
+    char tz[32];
+    if (DAYLIGHT_OFFSET == 3600) {
+        snprintf(tz, sizeof(tz), "UTC%ldDST", offset / 3600);
+    } else {
+        snprintf(tz, sizeof(tz), "UTC%ldDST%ld", offset / 3600, (offset - DAYLIGHT_OFFSET) / 3600);
+    }
+    setenv("TZ", tz, 1);
+    tzset();
+}
+
+void TimeModule::begin() {
+    if (started) {
+        return;
+    }
+
+    // SNTP runs in the background; nothing here waits for the first sync
+    // Format: timezone offset, daylight offset, ntp server
+    configTime(TIMEZONE_OFFSET * 3600, DAYLIGHT_OFFSET, "pool.ntp.org", "time.nist.gov");
+    started = true;
+    Serial.println("NTP sync started in background");
+}
+
+bool TimeModule::isSynced() {
+    return isValidEpoch(time(nullptr));
+}
+
+bool TimeModule::isValidEpoch(time_t t) {
+    return t >= MIN_VALID_EPOCH;
+}
+
+bool TimeModule::getTime(struct tm* timeinfo) {
+    // getLocalTime() would block for up to 5s while unsynced, so check first
+    if (!isSynced()) {
+        return false;
+    }
+    return getLocalTime(timeinfo, 0);
+}
+
+String TimeModule::timestamp() {
+    struct tm timeinfo;
+    if (!getTime(&timeinfo)) {
+        return String();
+    }
+
+    char buf[32];
+    strftime(buf, sizeof(buf), "%Y%m%d_%H%M%S", &timeinfo);
+    return String(buf);
+}
+
+String TimeModule::generateImageFilename(int imageNumber) {
+    String stamp = timestamp();
+    if (stamp.length() > 0) {
+        return String(IMAGE_PREFIX) + stamp + String(IMAGE_EXTENSION);
+    }
+
+    // Fallback to counter until the clock is valid
+    return String(IMAGE_PREFIX) + String(imageNumber) + String(IMAGE_EXTENSION);
+}
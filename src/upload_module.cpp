@@ -0,0 +1,223 @@
+#include "upload_module.h"
+#include <WiFi.h>
+
+UploadModule::UploadModule(SDCardModule* sd)
+    : sdCard(sd), enabled(false), freeSlots(NULL), readySlots(NULL),
+      cursorOffset(0), uploadedCount(0), filesSent(0), failures(0), rejected(0),
+      bytesSent(0), lastBatchKBps(0), backoffMs(0) {}
+
+bool UploadModule::begin() {
+    freeSlots = xQueueCreate(UPLOAD_PIPELINE_DEPTH, sizeof(UploadItem*));
+    readySlots = xQueueCreate(UPLOAD_PIPELINE_DEPTH, sizeof(UploadItem*));
+    if (!freeSlots || !readySlots) {
+        Serial.println("Failed to create upload queues");
+        return false;
+    }
+
+    for (int i = 0; i < UPLOAD_PIPELINE_DEPTH; i++) {
+        slots[i].buf = (uint8_t*)ps_malloc(UPLOAD_BUFFER_SIZE);
+        if (!slots[i].buf) {
+            Serial.println("Failed to allocate upload buffer");
+            return false;
+        }
+        UploadItem* slot = &slots[i];
+        xQueueSend(freeSlots, &slot, 0);
+    }
+
+    loadCursor();
+
+    xTaskCreatePinnedToCore(readerTask, "upload_reader", 4096, this, 1, NULL, 0);
+    xTaskCreatePinnedToCore(uploaderTask, "upload_sender", 8192, this, 1, NULL, 0);
+
+    // Queue depth is not logged here: it needs an index scan on the boot path
+    enabled = true;
+    Serial.printf("Uploader started: %s, %u files uploaded\n", UPLOAD_COLLECTOR_URL, uploadedCount);
+    return true;
+}
+
+bool UploadModule::isEnabled() {
+    return enabled;
+}
+
+UploadStats UploadModule::getStats() {
+    UploadStats stats;
+    size_t total = sdCard->getIndexEntryCount();
+    stats.queueDepth = total > uploadedCount ? total - uploadedCount : 0;
+    stats.uploadedCount = uploadedCount;
+    stats.filesSent = filesSent;
+    stats.failures = failures;
+    stats.rejected = rejected;
+    stats.bytesSent = bytesSent;
+    stats.lastBatchKBps = lastBatchKBps;
+    stats.backoffMs = backoffMs;
+    return stats;
+}
+
+void UploadModule::loadCursor() {
+    // Format: "<index byte offset>,<entries consumed>"
+    String contents = sdCard->readStateFile(UPLOAD_CURSOR_FILE);
+    int comma = contents.indexOf(',');
+    if (comma > 0) {
+        cursorOffset = (size_t)contents.substring(0, comma).toInt();
+        uploadedCount = (size_t)contents.substring(comma + 1).toInt();
+    }
+}
+
+void UploadModule::saveCursor() {
+    String contents = String(cursorOffset) + "," + String(uploadedCount);
+    if (!sdCard->writeStateFile(UPLOAD_CURSOR_FILE, contents)) {
+        Serial.println("Failed to persist upload cursor");
+    }
+}
+
+bool UploadModule::loadItem(UploadItem* item, const IndexEntry& entry) {
+    strlcpy(item->filename, entry.filename.c_str(), sizeof(item->filename));
+    item->len = 0;
+    item->skip = true;
+
+    File file = sdCard->openFile(entry.filename);
+    if (!file) {
+        Serial.printf("Upload skipping missing file %s\n", item->filename);
+        return false;
+    }
+
+    size_t size = file.size();
+    if (size > UPLOAD_BUFFER_SIZE) {
+        Serial.printf("Upload skipping %s: %u bytes exceeds buffer\n", item->filename, size);
+        file.close();
+        return false;
+    }
+
+    item->len = file.read(item->buf, size);
+    file.close();
+    item->skip = (item->len != size);
+    return !item->skip;
+}
+
+// Returns the HTTP status, or a negative HTTPClient error
+int UploadModule::sendItem(HTTPClient& http, UploadItem* item) {
+    // Headers are cleared after every request, so set them each time
+    http.addHeader("Content-Type", "image/jpeg");
+    http.addHeader("X-Filename", item->filename);
+
+    int code = http.POST(item->buf, item->len);
+    if (code > 0) {
+        http.getString();  // Drain the body so the connection can be reused
+    }
+
+    if (code < 200 || code >= 300) {
+        Serial.printf("Upload of %s failed: %d\n", item->filename, code);
+    }
+    return code;
+}
+
+// Transport errors, 5xx, 408 and 429 may succeed later; other 4xx will not
+bool UploadModule::isRetryable(int code) {
+    return code <= 0 || code >= 500 || code == 408 || code == 429;
+}
+
+// Reads the next indexed file from SD while the previous one is on the wire
+void UploadModule::readerTask(void* param) {
+    UploadModule* self = (UploadModule*)param;
+    size_t readOffset = self->cursorOffset;
+
+    while (true) {
+        IndexEntry entry;
+        size_t nextOffset;
+        if (!self->sdCard->readIndexEntry(readOffset, entry, nextOffset)) {
+            readOffset = nextOffset;  // Past any malformed lines at the tail
+            delay(UPLOAD_IDLE_POLL_MS);
+            continue;
+        }
+
+        UploadItem* item;
+        xQueueReceive(self->freeSlots, &item, portMAX_DELAY);
+        self->loadItem(item, entry);
+        item->nextOffset = nextOffset;
+        xQueueSend(self->readySlots, &item, portMAX_DELAY);
+        readOffset = nextOffset;
+    }
+}
+
+// Sends ready files in batches over one keep-alive connection
+void UploadModule::uploaderTask(void* param) {
+    UploadModule* self = (UploadModule*)param;
+    HTTPClient http;
+    http.setReuse(true);
+
+    while (true) {
+        UploadItem* item = nullptr;
+        xQueueReceive(self->readySlots, &item, portMAX_DELAY);
+
+        bool connected = false;
+        int batchCount = 0;
+        uint64_t batchBytes = 0;
+        unsigned long batchStart = millis();
+
+        while (item) {
+            if (!item->skip) {
+                if (WiFi.status() != WL_CONNECTED) {
+                    delay(UPLOAD_BACKOFF_MIN_MS);
+                    continue;
+                }
+
+                if (!connected) {
+                    http.begin(UPLOAD_COLLECTOR_URL);
+                    connected = true;
+                }
+
+                int code = self->sendItem(http, item);
+                if (code >= 200 && code < 300) {
+                    self->backoffMs = 0;
+                    self->filesSent++;
+                    self->bytesSent += item->len;
+                    batchBytes += item->len;
+                    batchCount++;
+                } else if (!isRetryable(code)) {
+                    // Retrying would block every file behind this one
+                    self->rejected++;
+                    Serial.printf("Collector rejected %s (%d), skipping it\n", item->filename, code);
+                } else {
+                    // Drop the connection and retry the same file after a backoff
+                    http.end();
+                    connected = false;
+                    self->failures++;
+                    self->backoffMs = self->backoffMs ? min(self->backoffMs * 2, (uint32_t)UPLOAD_BACKOFF_MAX_MS)
+                                                      : UPLOAD_BACKOFF_MIN_MS;
+                    Serial.printf("Retrying upload in %lu ms\n", (unsigned long)self->backoffMs);
+                    delay(self->backoffMs);
+                    continue;
+                }
+            }
+
+            // Only advance the persisted cursor once the collector has the
+            // file or has refused it for good
+            self->cursorOffset = item->nextOffset;
+            self->uploadedCount++;
+            self->saveCursor();
+            xQueueSend(self->freeSlots, &item, portMAX_DELAY);
+            item = nullptr;
+
+            if (batchCount >= UPLOAD_BATCH_SIZE) {
+                break;
+            }
+
+            // Keep the connection open if the reader has the next file ready
+            if (xQueueReceive(self->readySlots, &item, pdMS_TO_TICKS(100)) != pdTRUE) {
+                item = nullptr;
+            }
+        }
+
+        if (connected) {
+            http.end();
+        }
+
+        if (batchCount > 0) {
+            unsigned long elapsed = max(millis() - batchStart, 1UL);
+            self->lastBatchKBps = (batchBytes / 1024.0f) * 1000.0f / elapsed;
+            Serial.printf("Uploaded %d files (%llu KB) at %.1f KB/s, %u queued\n",
+                          batchCount, batchBytes / 1024, self->lastBatchKBps,
+                          self->getStats().queueDepth);
+        }
+    }
+}
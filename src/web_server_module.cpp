@@ -2,54 +2,132 @@
 #include "config.h"
 #include <Arduino.h>
 #include <WiFi.h>
-#include <time.h>
 #include "esp_camera.h"
 #include "img_converters.h"
+#include "esp_idf_version.h"
 
-#define PART_BOUNDARY "123456789000000000000987654321"
-static const char* _STREAM_CONTENT_TYPE = "multipart/x-mixed-replace;boundary=" PART_BOUNDARY;
-static const char* _STREAM_BOUNDARY = "\r\n--" PART_BOUNDARY "\r\n";
-static const char* _STREAM_PART = "Content-Type: image/jpeg\r\nContent-Length: %u\r\n\r\n";
+#include "stream_protocol.h"
 
-WebServerModule::WebServerModule(CameraModule* cam, SDCardModule* sd, int* imgCount)
-    : server(WEB_SERVER_PORT), stream_httpd(NULL), camera(cam), sdCard(sd), imageCount(imgCount) {}
+static const char* _STREAM_CONTENT_TYPE = STREAM_CONTENT_TYPE;
+static const char* _STREAM_BOUNDARY = STREAM_BOUNDARY;
+static const char* _STREAM_PART = STREAM_PART;
+
+#if ESP_IDF_VERSION < ESP_IDF_VERSION_VAL(5, 1, 0)
+#error "Async request handling needs ESP-IDF 5.1 or newer (Arduino core 3.x)"
+#endif
+
+WebServerModule::WebServerModule(CameraModule* cam, SDCardModule* sd, TimeModule* tm, UploadModule* up,
+                                 RecorderModule* rec, RetentionModule* rm, std::atomic<int>* imgCount)
+    : httpd(NULL), camera(cam), sdCard(sd), timeModule(tm), uploader(up), recorder(rec), retention(rm),
+      imageCount(imgCount),
+      captureMutex(NULL) {}
 
 bool WebServerModule::init() {
-    // Setup routes for WebServer (static pages)
-    server.on("/", [this]() { this->handleRoot(); });
-    server.on("/capture", [this]() { this->handleCapture(); });
-    server.on("/list", [this]() { this->handleList(); });
-    server.on("/download", [this]() { this->handleDownload(); });
-    server.on("/flash/on", [this]() { this->handleFlashOn(); });
-    server.on("/flash/off", [this]() { this->handleFlashOff(); });
-
-    server.begin();
-    Serial.println("Web server started on port 80");
-
-    // Setup ESP HTTP Server for streaming (more efficient)
+    captureMutex = xSemaphoreCreateMutex();
+
+    // Long-running work leaves the httpd task free for other requests
+    if (!startPool(&jobPool, HTTP_ASYNC_WORKERS, "http_job") ||
+        !startPool(&streamPool, HTTP_STREAM_WORKERS, "http_stream")) {
+        Serial.println("Failed to start HTTP worker pools");
+        return false;
+    }
+
+    routes[0] = { "/",              &WebServerModule::handleRoot,         NULL,        this };
+    routes[1] = { STREAM_PATH,      &WebServerModule::handleStream,       &streamPool, this };
+    routes[2] = { "/capture",       &WebServerModule::handleCapture,      &jobPool,    this };
+    routes[3] = { "/list",          &WebServerModule::handleList,         &jobPool,    this };
+    routes[4] = { DOWNLOAD_PATH,    &WebServerModule::handleDownload,     &jobPool,    this };
+    routes[5] = { "/flash/on",      &WebServerModule::handleFlashOn,      NULL,        this };
+    routes[6] = { "/flash/off",     &WebServerModule::handleFlashOff,     NULL,        this };
+    routes[7] = { "/upload/status", &WebServerModule::handleUploadStatus, &jobPool,    this };
+    routes[8] = { "/roi",           &WebServerModule::handleRoi,          NULL,        this };
+    routes[9] = { "/roi/reset",     &WebServerModule::handleRoiReset,     NULL,        this };
+    routes[10] = { "/record/start",  &WebServerModule::handleRecordStart,  NULL,        this };
+    routes[11] = { "/record/stop",   &WebServerModule::handleRecordStop,   NULL,        this };
+    routes[12] = { "/record/status", &WebServerModule::handleRecordStatus, NULL,        this };
+    routes[13] = { "/retention/status", &WebServerModule::handleRetentionStatus, NULL,  this };
+    routes[14] = { INDEX_PATH,       &WebServerModule::handleIndex,        &jobPool,    this };
+
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
-    config.server_port = 81;
-    config.ctrl_port = 32768;
-
-    httpd_uri_t stream_uri = {
-        .uri       = "/",
-        .method    = HTTP_GET,
-        .handler   = streamHandler,
-        .user_ctx  = NULL
-    };
-
-    if (httpd_start(&stream_httpd, &config) == ESP_OK) {
-        httpd_register_uri_handler(stream_httpd, &stream_uri);
-        Serial.println("Stream server started on port 81");
-    } else {
-        Serial.println("Failed to start stream server");
+    config.server_port = WEB_SERVER_PORT;
+    config.max_uri_handlers = sizeof(routes) / sizeof(routes[0]);
+    config.max_open_sockets = HTTP_MAX_OPEN_SOCKETS;
+    config.lru_purge_enable = true;  // Recycle idle keep-alive sockets under load
+    config.keep_alive_enable = true;
+
+    if (httpd_start(&httpd, &config) != ESP_OK) {
+        Serial.println("Failed to start web server");
+        return false;
+    }
+
+    for (size_t i = 0; i < sizeof(routes) / sizeof(routes[0]); i++) {
+        httpd_uri_t uri = {
+            .uri       = routes[i].uri,
+            .method    = HTTP_GET,
+            .handler   = dispatchRoute,
+            .user_ctx  = &routes[i]
+        };
+        httpd_register_uri_handler(httpd, &uri);
     }
 
+    Serial.printf("Web server started on port %d\n", WEB_SERVER_PORT);
     return true;
 }
 
-void WebServerModule::handleClient() {
-    server.handleClient();
+bool WebServerModule::startPool(AsyncPool* pool, int workers, const char* name) {
+    pool->jobs = xQueueCreate(workers, sizeof(AsyncJob));
+    pool->idle = xSemaphoreCreateCounting(workers, workers);
+    if (!pool->jobs || !pool->idle) {
+        return false;
+    }
+
+    for (int i = 0; i < workers; i++) {
+        if (xTaskCreatePinnedToCore(asyncWorkerTask, name, 8192, pool, 5, NULL, 0) != pdPASS) {
+            return false;
+        }
+    }
+    return true;
+}
+
+esp_err_t WebServerModule::dispatchRoute(httpd_req_t *req) {
+    Route* route = (Route*)req->user_ctx;
+    if (!route->pool) {
+        return (route->server->*route->handler)(req);
+    }
+    return route->server->submitAsync(req, route);
+}
+
+esp_err_t WebServerModule::submitAsync(httpd_req_t *req, Route* route) {
+    // Reserve a worker first so a busy pool never queues unbounded work
+    if (xSemaphoreTake(route->pool->idle, 0) != pdTRUE) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "1");
+        return httpd_resp_sendstr(req, "Server busy, try again");
+    }
+
+    httpd_req_t* asyncReq = NULL;
+    if (httpd_req_async_handler_begin(req, &asyncReq) != ESP_OK) {
+        xSemaphoreGive(route->pool->idle);
+        return ESP_FAIL;
+    }
+
+    AsyncJob job = { asyncReq, route };
+    xQueueSend(route->pool->jobs, &job, portMAX_DELAY);
+    return ESP_OK;
+}
+
+void WebServerModule::asyncWorkerTask(void* param) {
+    AsyncPool* pool = (AsyncPool*)param;
+    AsyncJob job;
+
+    while (true) {
+        if (xQueueReceive(pool->jobs, &job, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        (job.route->server->*job.route->handler)(job.req);
+        httpd_req_async_handler_complete(job.req);
+        xSemaphoreGive(pool->idle);
+    }
 }
 
 void WebServerModule::printServerInfo() {
@@ -60,12 +138,20 @@ void WebServerModule::printServerInfo() {
     Serial.println("========================================");
     Serial.println("Available endpoints:");
     Serial.printf("  http://%s/          - Home page\n", ip.c_str());
-    Serial.printf("  http://%s:81/        - Live stream (ESP HTTP Server)\n", ip.c_str());
+    Serial.printf("  http://%s/stream     - Live stream\n", ip.c_str());
     Serial.printf("  http://%s/capture    - Take picture\n", ip.c_str());
     Serial.printf("  http://%s/list       - List images\n", ip.c_str());
     Serial.printf("  http://%s/download?file= - Download image\n", ip.c_str());
+    Serial.printf("  http://%s/index?offset= - Raw image index (for mirroring)\n", ip.c_str());
     Serial.printf("  http://%s/flash/on   - Flash ON\n", ip.c_str());
     Serial.printf("  http://%s/flash/off  - Flash OFF\n", ip.c_str());
+    Serial.printf("  http://%s/upload/status - Upload queue and throughput\n", ip.c_str());
+    Serial.printf("  http://%s/roi?x=&y=&w=&h= - Set sensor region of interest\n", ip.c_str());
+    Serial.printf("  http://%s/roi/reset  - Full field of view\n", ip.c_str());
+    Serial.printf("  http://%s/record/start - Record stream to SD\n", ip.c_str());
+    Serial.printf("  http://%s/record/stop  - Stop recording\n", ip.c_str());
+    Serial.printf("  http://%s/record/status - Recording stats\n", ip.c_str());
+    Serial.printf("  http://%s/retention/status - Free space and evictions\n", ip.c_str());
     Serial.println("========================================\n");
 }
 
@@ -91,16 +177,20 @@ String WebServerModule::generateHTMLFooter() {
     return "</div></body></html>";
 }
 
-void WebServerModule::handleRoot() {
-    String ip = WiFi.localIP().toString();
+esp_err_t WebServerModule::handleRoot(httpd_req_t *req) {
     String html = generateHTMLHeader("Plant Monitor");
     html += "<h1>Plant Monitor Dashboard</h1>";
     html += "<p>Welcome to your ESP32-CAM Plant Monitoring System</p>";
     html += "<div>";
-    html += "<a class='button' href='http://" + ip + ":81/' target='_blank'>Live Stream</a>";
+    html += "<a class='button' href='/stream' target='_blank'>Live Stream</a>";
     html += "<a class='button' href='/capture'>Take Picture Now</a>";
     html += "<a class='button' href='/list'>View Saved Images</a>";
     html += "</div>";
+    html += "<h2>Recording</h2>";
+    html += "<div>";
+    html += "<a class='button' href='/record/start'>Start Recording</a>";
+    html += "<a class='button' href='/record/stop'>Stop Recording</a>";
+    html += "</div>";
     html += "<h2>Flash Control</h2>";
     html += "<div>";
     html += "<a class='button' href='/flash/on'>Turn Flash ON</a>";
@@ -108,11 +198,11 @@ void WebServerModule::handleRoot() {
     html += "</div>";
     html += generateHTMLFooter();
 
-    server.send(200, "text/html", html);
+    return sendHTML(req, html);
 }
 
-// ESP HTTP Server streaming handler (proven to work well)
-esp_err_t WebServerModule::streamHandler(httpd_req_t *req) {
+// Runs on a stream worker, so a viewer never holds up the httpd task
+esp_err_t WebServerModule::handleStream(httpd_req_t *req) {
     camera_fb_t * fb = NULL;
     esp_err_t res = ESP_OK;
     size_t _jpg_buf_len = 0;
@@ -143,6 +233,8 @@ esp_err_t WebServerModule::streamHandler(httpd_req_t *req) {
             } else {
                 _jpg_buf_len = fb->len;
                 _jpg_buf = fb->buf;
+                // Recording shares this frame rather than taking its own
+                recorder->offerFrame(fb);
             }
         }
         if(res == ESP_OK){
@@ -172,8 +264,16 @@ esp_err_t WebServerModule::streamHandler(httpd_req_t *req) {
     return res;
 }
 
-void WebServerModule::handleCapture() {
+esp_err_t WebServerModule::handleCapture(httpd_req_t *req) {
     Serial.println("Manual capture requested via web interface");
+
+    // Until SD init has recovered the journal and found the next image
+    // number, a capture could reuse (and overwrite) an existing filename
+    if (*imageCount < 0) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "1");
+        return httpd_resp_sendstr(req, "SD card not ready, try again");
+    }
     String result = captureAndSaveImage();
 
     String html = generateHTMLHeader("Capture Result");
@@ -183,10 +283,10 @@ void WebServerModule::handleCapture() {
     html += "<a class='button' href='/list'>View Images</a>";
     html += generateHTMLFooter();
 
-    server.send(200, "text/html", html);
+    return sendHTML(req, html);
 }
 
-void WebServerModule::handleList() {
+esp_err_t WebServerModule::handleList(httpd_req_t *req) {
     String html = generateHTMLHeader("Saved Images");
     html += "<h1>Saved Images</h1>";
     html += "<a class='button' href='/'>← Back to Home</a>";
@@ -207,54 +307,99 @@ void WebServerModule::handleList() {
     }
 
     html += generateHTMLFooter();
-    server.send(200, "text/html", html);
+    return sendHTML(req, html);
 }
 
-void WebServerModule::handleDownload() {
-    if (!server.hasArg("file")) {
-        server.send(400, "text/plain", "Missing file parameter");
-        return;
+// Raw index lines from a byte offset, so mirrors only fetch what is new
+esp_err_t WebServerModule::handleIndex(httpd_req_t *req) {
+    size_t offset = (size_t)getQueryParam(req, "offset").toInt();
+
+    httpd_resp_set_type(req, "text/plain");
+    File index = sdCard->openFile(IMAGE_INDEX_FILE);
+    if (!index) {
+        return httpd_resp_send(req, NULL, 0);
+    }
+    if (offset > index.size() || !index.seek(offset)) {
+        index.close();
+        return httpd_resp_send(req, NULL, 0);
     }
 
-    String filename = server.arg("file");
+    char chunk[1024];
+    esp_err_t res = ESP_OK;
+    int n;
+    while (res == ESP_OK && (n = index.read((uint8_t*)chunk, sizeof(chunk))) > 0) {
+        res = httpd_resp_send_chunk(req, chunk, n);
+    }
+    index.close();
+
+    if (res == ESP_OK) {
+        res = httpd_resp_send_chunk(req, NULL, 0);
+    }
+    return res;
+}
+
+esp_err_t WebServerModule::handleDownload(httpd_req_t *req) {
+    String requested = getQueryParam(req, "file");
+    if (requested.length() == 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing file parameter");
+        return ESP_OK;
+    }
+
+    String filename = requested;
     if (!filename.startsWith("/")) {
         filename = "/" + filename;
     }
 
     File file = sdCard->openFile(filename);
     if (!file) {
-        server.send(404, "text/plain", "File not found");
-        return;
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "File not found");
+        return ESP_OK;
     }
 
-    server.sendHeader("Content-Disposition", "attachment; filename=" + server.arg("file"));
-    server.streamFile(file, "image/jpeg");
+    String disposition = "attachment; filename=" + requested;
+    httpd_resp_set_type(req, filename.endsWith(".avi") ? "video/x-msvideo" : "image/jpeg");
+    httpd_resp_set_hdr(req, "Content-Disposition", disposition.c_str());
+
+    // Large chunks keep SD reads and TCP sends efficient
+    uint8_t* chunk = (uint8_t*)malloc(HTTP_DOWNLOAD_CHUNK_SIZE);
+    if (!chunk) {
+        file.close();
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return ESP_OK;
+    }
+
+    esp_err_t res = ESP_OK;
+    int n;
+    while (res == ESP_OK && (n = file.read(chunk, HTTP_DOWNLOAD_CHUNK_SIZE)) > 0) {
+        res = httpd_resp_send_chunk(req, (const char *)chunk, n);
+    }
+    free(chunk);
     file.close();
+
+    if (res == ESP_OK) {
+        res = httpd_resp_send_chunk(req, NULL, 0);
+    }
+    return res;
 }
 
 String WebServerModule::captureAndSaveImage() {
+    // Captures run on pool workers; serialize them so filenames never collide
+    xSemaphoreTake(captureMutex, portMAX_DELAY);
     camera_fb_t *fb = camera->captureImage();
 
     if (!fb) {
+        xSemaphoreGive(captureMutex);
         Serial.println("Camera capture failed");
         return "Camera capture failed";
     }
 
-    // Generate timestamp-based filename
-    struct tm timeinfo;
-    String filename;
-    if (getLocalTime(&timeinfo)) {
-        char timestamp[32];
-        strftime(timestamp, sizeof(timestamp), "%Y%m%d_%H%M%S", &timeinfo);
-        filename = String(IMAGE_PREFIX) + String(timestamp) + String(IMAGE_EXTENSION);
-    } else {
-        // Fallback to counter if time not available
-        filename = String(IMAGE_PREFIX) + String(*imageCount) + String(IMAGE_EXTENSION);
-    }
-    (*imageCount)++;
+    // Timestamp-based filename once NTP has synced, counter before that
+    String filename = timeModule->generateImageFilename((*imageCount)++);
 
-    bool success = sdCard->saveImage(fb, filename);
+    // Retention tracking is part of the save, so a power cut cannot skip it
+    bool success = sdCard->saveImage(fb, filename, RETAIN_CAPTURE);
     camera->releaseFrameBuffer(fb);
+    xSemaphoreGive(captureMutex);
 
     if (!success) {
         return "Failed to save image to SD card";
@@ -263,20 +408,153 @@ String WebServerModule::captureAndSaveImage() {
     return "Image saved successfully: " + filename;
 }
 
-void WebServerModule::handleFlashOn() {
+esp_err_t WebServerModule::handleFlashOn(httpd_req_t *req) {
     camera->turnOnFlash();
     Serial.println("Flash turned ON via web interface");
 
     // Redirect back to homepage
-    server.sendHeader("Location", "/");
-    server.send(302, "text/plain", "");
+    return redirectHome(req);
 }
 
-void WebServerModule::handleFlashOff() {
+esp_err_t WebServerModule::handleFlashOff(httpd_req_t *req) {
     camera->turnOffFlash();
     Serial.println("Flash turned OFF via web interface");
 
     // Redirect back to homepage
-    server.sendHeader("Location", "/");
-    server.send(302, "text/plain", "");
+    return redirectHome(req);
+}
+
+String WebServerModule::getQueryParam(httpd_req_t *req, const char* key) {
+    size_t len = httpd_req_get_url_query_len(req);
+    if (len == 0) {
+        return String();
+    }
+
+    String value;
+    char* query = (char*)malloc(len + 1);
+    if (query && httpd_req_get_url_query_str(req, query, len + 1) == ESP_OK) {
+        char buf[128];
+        if (httpd_query_key_value(query, key, buf, sizeof(buf)) == ESP_OK) {
+            value = String(buf);
+        }
+    }
+    free(query);
+    return value;
+}
+
+esp_err_t WebServerModule::sendHTML(httpd_req_t *req, const String& html) {
+    httpd_resp_set_type(req, "text/html");
+    return httpd_resp_send(req, html.c_str(), html.length());
+}
+
+esp_err_t WebServerModule::redirectHome(httpd_req_t *req) {
+    httpd_resp_set_status(req, "302 Found");
+    httpd_resp_set_hdr(req, "Location", "/");
+    return httpd_resp_send(req, NULL, 0);
+}
+
+esp_err_t WebServerModule::handleUploadStatus(httpd_req_t *req) {
+    httpd_resp_set_type(req, "application/json");
+    if (!uploader->isEnabled()) {
+        return httpd_resp_sendstr(req, "{\"enabled\":false}");
+    }
+
+    UploadStats stats = uploader->getStats();
+    String json = "{\"enabled\":true";
+    json += ",\"queue_depth\":" + String(stats.queueDepth);
+    json += ",\"uploaded\":" + String(stats.uploadedCount);
+    json += ",\"files_sent\":" + String(stats.filesSent);
+    json += ",\"kb_sent\":" + String((unsigned long)(stats.bytesSent / 1024));
+    json += ",\"failures\":" + String(stats.failures);
+    json += ",\"rejected\":" + String(stats.rejected);
+    json += ",\"last_batch_kbps\":" + String(stats.lastBatchKBps, 1);
+    json += ",\"backoff_ms\":" + String(stats.backoffMs);
+    json += "}";
+
+    return httpd_resp_send(req, json.c_str(), json.length());
+}
+
+esp_err_t WebServerModule::handleRoi(httpd_req_t *req) {
+    String x = getQueryParam(req, "x");
+    String y = getQueryParam(req, "y");
+    String w = getQueryParam(req, "w");
+    String h = getQueryParam(req, "h");
+
+    // Without parameters this just reports the current window
+    if (x.length() || y.length() || w.length() || h.length()) {
+        if (!x.length() || !y.length() || !w.length() || !h.length()) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Need x, y, w and h");
+            return ESP_OK;
+        }
+        if (!camera->setRegionOfInterest(x.toInt(), y.toInt(), w.toInt(), h.toInt())) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid region of interest");
+            return ESP_OK;
+        }
+    }
+
+    return sendRoiStatus(req);
+}
+
+esp_err_t WebServerModule::handleRoiReset(httpd_req_t *req) {
+    if (!camera->clearRegionOfInterest()) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to reset region of interest");
+        return ESP_OK;
+    }
+    return sendRoiStatus(req);
+}
+
+esp_err_t WebServerModule::sendRoiStatus(httpd_req_t *req) {
+    RegionOfInterest roi = camera->getRegionOfInterest();
+    String json = "{\"enabled\":" + String(roi.enabled ? "true" : "false");
+    if (roi.enabled) {
+        json += ",\"x\":" + String(roi.x);
+        json += ",\"y\":" + String(roi.y);
+        json += ",\"w\":" + String(roi.width);
+        json += ",\"h\":" + String(roi.height);
+        json += ",\"output_w\":" + String(roi.outputWidth);
+        json += ",\"output_h\":" + String(roi.outputHeight);
+    }
+    json += "}";
+
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, json.c_str(), json.length());
+}
+
+esp_err_t WebServerModule::handleRecordStart(httpd_req_t *req) {
+    if (!recorder->start()) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Recorder not available");
+        return ESP_OK;
+    }
+    return handleRecordStatus(req);
+}
+
+esp_err_t WebServerModule::handleRecordStop(httpd_req_t *req) {
+    recorder->stop();
+    return handleRecordStatus(req);
+}
+
+esp_err_t WebServerModule::handleRecordStatus(httpd_req_t *req) {
+    RecorderStats stats = recorder->getStats();
+    String json = "{\"recording\":" + String(stats.recording ? "true" : "false");
+    json += ",\"frames_written\":" + String(stats.framesWritten);
+    json += ",\"frames_dropped\":" + String(stats.framesDropped);
+    json += ",\"segments\":" + String(stats.segments);
+    json += ",\"fps\":" + String(stats.fps, 1);
+    json += ",\"segment\":\"" + stats.currentSegment + "\"";
+    json += "}";
+
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, json.c_str(), json.length());
+}
+
+esp_err_t WebServerModule::handleRetentionStatus(httpd_req_t *req) {
+    RetentionStats stats = retention->getStats();
+    String json = "{\"free_mb\":" + String((unsigned long)(stats.freeBytes / (1024 * 1024)));
+    json += ",\"under_pressure\":" + String(stats.underPressure ? "true" : "false");
+    json += ",\"evicted\":" + String(stats.evicted);
+    json += ",\"last_evicted\":\"" + stats.lastEvicted + "\"";
+    json += "}";
+
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, json.c_str(), json.length());
 }
@@ -0,0 +1,331 @@
+// Aggregator end to end against a simulated camera that speaks the firmware's
+// wire format: chunked multipart /stream, /index?offset= and /download.
+//
+//   pio test -e native -f test_aggregator
+
+#include <unity.h>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include <jpeglib.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "stream_protocol.h"
+#include "aggregator/aggregator_config.h"
+#include "aggregator/aggregator_server.h"
+#include "aggregator/archive_mirror.h"
+#include "aggregator/camera_feed.h"
+#include "aggregator/http_util.h"
+
+#define SIM_PORT 18180
+#define AGG_PORT 18181
+
+static std::string encodeJpeg(int width, int height, int shade) {
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+
+    unsigned char* out = NULL;
+    unsigned long outSize = 0;
+    jpeg_mem_dest(&cinfo, &out, &outSize);
+    cinfo.image_width = width;
+    cinfo.image_height = height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_start_compress(&cinfo, TRUE);
+
+    std::vector<unsigned char> row(width * 3);
+    while (cinfo.next_scanline < cinfo.image_height) {
+        for (int x = 0; x < width * 3; x++) {
+            row[x] = (unsigned char)((x + cinfo.next_scanline + shade) & 0xFF);
+        }
+        JSAMPROW ptr = row.data();
+        jpeg_write_scanlines(&cinfo, &ptr, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+
+    std::string jpeg((const char*)out, outSize);
+    free(out);
+    return jpeg;
+}
+
+static bool jpegSize(const std::string& jpeg, int& width, int& height) {
+    struct jpeg_decompress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, (const unsigned char*)jpeg.data(), jpeg.size());
+    bool ok = jpeg_read_header(&cinfo, TRUE) == JPEG_HEADER_OK;
+    width = cinfo.image_width;
+    height = cinfo.image_height;
+    jpeg_destroy_decompress(&cinfo);
+    return ok;
+}
+
+// Serves what the firmware serves, from memory
+class SimCamera {
+public:
+    std::string frame;
+    std::map<std::string, std::string> files;  // Index filename -> contents
+    std::string index;
+    size_t completeIndexBytes = 0;
+    std::atomic<int> streamConnections{0};
+
+    bool start(int port) {
+        listenFd = socket(AF_INET, SOCK_STREAM, 0);
+        int one = 1;
+        setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(port);
+        if (bind(listenFd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(listenFd, 16) < 0) {
+            return false;
+        }
+        std::thread([this] {
+            int fd;
+            while ((fd = accept(listenFd, NULL, NULL)) >= 0) {
+                std::thread(&SimCamera::serve, this, fd).detach();
+            }
+        }).detach();
+        return true;
+    }
+
+private:
+    int listenFd = -1;
+
+    static void sendChunk(int fd, const std::string& data, bool& ok) {
+        char size[16];
+        snprintf(size, sizeof(size), "%zx\r\n", data.size());
+        ok = ok && sendAll(fd, size, strlen(size)) && sendAll(fd, data) && sendAll(fd, "\r\n", 2);
+    }
+
+    static void respond(int fd, int status, const std::string& body) {
+        std::string header = "HTTP/1.1 " + std::to_string(status) + (status == 200 ? " OK" : " Not Found") +
+                             "\r\nContent-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n";
+        if (sendAll(fd, header)) {
+            sendAll(fd, body);
+        }
+    }
+
+    void serve(int fd) {
+        SocketSource source(fd);
+        BufferedReader in(&source);
+        std::string requestLine;
+        std::map<std::string, std::string> headers;
+        if (!in.readLine(requestLine) || !readHeaders(in, headers)) {
+            close(fd);
+            return;
+        }
+        std::string path = requestLine.substr(4, requestLine.find(' ', 4) - 4);
+
+        if (path == STREAM_PATH) {
+            // Same framing as handleStream: part header, JPEG, boundary, chunked
+            streamConnections++;
+            std::string header = "HTTP/1.1 200 OK\r\nContent-Type: " STREAM_CONTENT_TYPE
+                                 "\r\nTransfer-Encoding: chunked\r\n\r\n";
+            bool ok = sendAll(fd, header);
+            char part[64];
+            while (ok) {
+                snprintf(part, sizeof(part), STREAM_PART, (unsigned)frame.size());
+                sendChunk(fd, part, ok);
+                sendChunk(fd, frame, ok);
+                sendChunk(fd, STREAM_BOUNDARY, ok);
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            }
+        } else if (path.compare(0, strlen(INDEX_PATH "?offset="), INDEX_PATH "?offset=") == 0) {
+            size_t offset = strtoul(path.c_str() + strlen(INDEX_PATH "?offset="), NULL, 10);
+            respond(fd, 200, offset < index.size() ? index.substr(offset) : "");
+        } else if (path.compare(0, strlen(DOWNLOAD_PATH "?file="), DOWNLOAD_PATH "?file=") == 0) {
+            auto it = files.find("/" + path.substr(strlen(DOWNLOAD_PATH "?file=")));
+            respond(fd, it == files.end() ? 404 : 200, it == files.end() ? "" : it->second);
+        } else {
+            respond(fd, 404, "");
+        }
+        close(fd);
+    }
+};
+
+static SimCamera sim;
+static std::string archiveDir;
+
+static int get(const std::string& path, std::string& body) {
+    HttpConnection conn;
+    if (!conn.get("127.0.0.1", AGG_PORT, path) || !conn.readAll(body)) {
+        return -1;
+    }
+    return conn.status();
+}
+
+static bool readFile(const std::string& path, std::string& out) {
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) {
+        return false;
+    }
+    char buf[4096];
+    size_t n;
+    out.clear();
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        out.append(buf, n);
+    }
+    fclose(f);
+    return true;
+}
+
+template <typename Pred>
+static bool waitFor(Pred pred, int timeoutMs) {
+    for (int waited = 0; waited < timeoutMs; waited += 50) {
+        if (pred()) {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    return pred();
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_snapshot_matches_camera_frame() {
+    std::string body;
+    TEST_ASSERT_TRUE(waitFor([&] { return get("/cam/sim/snapshot.jpg", body) == 200; }, 5000));
+    TEST_ASSERT_TRUE(body == sim.frame);
+}
+
+void test_thumbnail_is_downscaled() {
+    std::string body;
+    TEST_ASSERT_EQUAL_INT(200, get("/cam/sim/thumb.jpg", body));
+    int width = 0, height = 0;
+    TEST_ASSERT_TRUE(jpegSize(body, width, height));
+    TEST_ASSERT_TRUE(width <= AGG_THUMB_MAX_WIDTH);
+    TEST_ASSERT_EQUAL_INT(width * 3 / 4, height);
+}
+
+// Several viewers all get frames while the camera sees one connection
+void test_stream_fans_out_over_one_upstream() {
+    const int viewers = 4;
+    std::atomic<int> satisfied{0};
+    std::vector<std::thread> threads;
+    for (int i = 0; i < viewers; i++) {
+        threads.emplace_back([&] {
+            HttpConnection conn;
+            if (!conn.get("127.0.0.1", AGG_PORT, "/cam/sim/stream") || conn.status() != 200) {
+                return;
+            }
+            std::string seen;
+            char buf[16 * 1024];
+            size_t frames = 0;
+            ssize_t r;
+            while (frames < 3 && (r = conn.body().read(buf, sizeof(buf))) > 0) {
+                seen.append(buf, r);
+                size_t pos = 0;
+                frames = 0;
+                while ((pos = seen.find(PART_BOUNDARY, pos)) != std::string::npos) {
+                    frames++;
+                    pos++;
+                }
+            }
+            if (frames >= 3 && seen.find(sim.frame) != std::string::npos) {
+                satisfied++;
+            }
+        });
+    }
+    for (std::thread& t : threads) {
+        t.join();
+    }
+
+    TEST_ASSERT_EQUAL_INT(viewers, satisfied.load());
+    TEST_ASSERT_EQUAL_INT(1, sim.streamConnections.load());
+}
+
+void test_cams_reports_connected() {
+    std::string body;
+    TEST_ASSERT_EQUAL_INT(200, get("/cams", body));
+    TEST_ASSERT_TRUE(body.find("\"name\":\"sim\"") != std::string::npos);
+    TEST_ASSERT_TRUE(body.find("\"connected\":true") != std::string::npos);
+}
+
+// Complete index lines are mirrored; evicted files and the partial tail are not
+void test_archive_mirrors_indexed_files() {
+    std::string offset;
+    TEST_ASSERT_TRUE(waitFor([&] {
+        return readFile(archiveDir + "/sim/.index_offset", offset) &&
+               strtoul(offset.c_str(), NULL, 10) == sim.completeIndexBytes;
+    }, 5000));
+
+    std::string contents;
+    TEST_ASSERT_TRUE(readFile(archiveDir + "/sim/plant_1.jpg", contents));
+    TEST_ASSERT_TRUE(contents == sim.files["/plant_1.jpg"]);
+    TEST_ASSERT_TRUE(readFile(archiveDir + "/sim/plant_2.jpg", contents));
+    TEST_ASSERT_TRUE(contents == sim.files["/plant_2.jpg"]);
+    TEST_ASSERT_FALSE(readFile(archiveDir + "/sim/evicted.jpg", contents));
+    TEST_ASSERT_FALSE(readFile(archiveDir + "/sim/plant_1.jpg.tmp", contents));
+
+    std::string body;
+    TEST_ASSERT_EQUAL_INT(200, get("/cam/sim/archive/plant_2.jpg", body));
+    TEST_ASSERT_TRUE(body == sim.files["/plant_2.jpg"]);
+    TEST_ASSERT_EQUAL_INT(200, get("/cam/sim/archive", body));
+    TEST_ASSERT_TRUE(body.find("plant_1.jpg") != std::string::npos);
+}
+
+void test_rejects_unknown_camera_and_bad_paths() {
+    std::string body;
+    TEST_ASSERT_EQUAL_INT(404, get("/cam/nope/snapshot.jpg", body));
+    TEST_ASSERT_EQUAL_INT(400, get("/cam/sim/archive/..", body));
+    TEST_ASSERT_EQUAL_INT(404, get("/cam/sim/archive/missing.jpg", body));
+}
+
+int main() {
+    char dirTemplate[] = "/tmp/agg_test_XXXXXX";
+    archiveDir = mkdtemp(dirTemplate);
+
+    sim.frame = encodeJpeg(640, 480, 0);
+    sim.files["/plant_1.jpg"] = encodeJpeg(320, 240, 50);
+    sim.files["/plant_2.jpg"] = encodeJpeg(320, 240, 100);
+    sim.index = "1700000000," + std::to_string(sim.files["/plant_1.jpg"].size()) + ",/plant_1.jpg\n" +
+                "1700000060," + std::to_string(sim.files["/plant_2.jpg"].size()) + ",/plant_2.jpg\n" +
+                "1700000120,1234,/evicted.jpg\n";
+    sim.completeIndexBytes = sim.index.size();
+    sim.index += "1700000180,99,/pla";  // Still being appended on the camera
+
+    signal(SIGPIPE, SIG_IGN);
+    if (!sim.start(SIM_PORT)) {
+        return 1;
+    }
+
+    std::vector<Camera> cameras;
+    cameras.push_back({ new CameraFeed("sim", "127.0.0.1", SIM_PORT),
+                        new ArchiveMirror("sim", "127.0.0.1", SIM_PORT, archiveDir + "/sim") });
+    AggregatorServer* server = new AggregatorServer(AGG_PORT, cameras);
+    if (!server->begin()) {
+        return 1;
+    }
+    std::thread([server] { server->run(); }).detach();
+    cameras[0].feed->start();
+    cameras[0].mirror->start();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_snapshot_matches_camera_frame);
+    RUN_TEST(test_thumbnail_is_downscaled);
+    RUN_TEST(test_stream_fans_out_over_one_upstream);
+    RUN_TEST(test_cams_reports_connected);
+    RUN_TEST(test_archive_mirrors_indexed_files);
+    RUN_TEST(test_rejects_unknown_camera_and_bad_paths);
+    int failures = UNITY_END();
+
+    // Feeds and mirrors hold blocking sockets; skip their destructors
+    fflush(stdout);
+    _exit(failures);
+}
@@ -0,0 +1,390 @@
+// Power-loss injection for the image save path. A fake filesystem cuts power
+// after a byte/operation budget, mid-write, mid-rename or mid-append; after a
+// "reboot" recovery must leave no truncated .jpg and no dangling index line.
+//
+//   pio test -e native -f test_image_store
+
+#include <unity.h>
+#include <cstdlib>
+#include <map>
+#include <set>
+#include <string>
+#include "image_store.h"
+
+#define INDEX "/images.idx"
+#define JOURNAL "/images.jnl"
+#define TEMP ".part"
+
+// In-memory filesystem; every mutation spends budget and the one that runs
+// out is applied only partially (writes and appends keep a prefix)
+class FaultyFs : public FileOps {
+public:
+    std::map<std::string, std::string> files;
+    long budget = -1;  // -1 = no cut
+    bool dead = false;
+    std::string failRemove;  // Next remove of this path fails, power stays on
+
+    void reboot() {
+        budget = -1;
+        dead = false;
+    }
+
+    bool exists(const char* path) override {
+        return !dead && files.count(path);
+    }
+
+    long size(const char* path) override {
+        auto it = files.find(path);
+        return dead || it == files.end() ? -1 : (long)it->second.size();
+    }
+
+    size_t read(const char* path, size_t offset, uint8_t* buf, size_t len) override {
+        auto it = files.find(path);
+        if (dead || it == files.end() || offset >= it->second.size()) {
+            return 0;
+        }
+        size_t n = std::min(len, it->second.size() - offset);
+        memcpy(buf, it->second.data() + offset, n);
+        return n;
+    }
+
+    bool write(const char* path, const uint8_t* data, size_t len) override {
+        if (!spend(1)) {
+            return false;
+        }
+        files[path].clear();
+        return appendBytes(path, data, len);
+    }
+
+    bool append(const char* path, const uint8_t* data, size_t len) override {
+        return spend(1) && appendBytes(path, data, len);
+    }
+
+    bool truncate(const char* path, size_t len) override {
+        auto it = files.find(path);
+        if (!spend(1) || it == files.end()) {
+            return false;
+        }
+        it->second.resize(std::min(len, it->second.size()));
+        return true;
+    }
+
+    bool rename(const char* from, const char* to) override {
+        auto it = files.find(from);
+        if (!spend(1) || it == files.end() || files.count(to)) {
+            return false;
+        }
+        files[to] = it->second;
+        files.erase(from);
+        return true;
+    }
+
+    bool remove(const char* path) override {
+        if (failRemove == path) {
+            failRemove.clear();
+            return false;
+        }
+        return spend(1) && files.erase(path) > 0;
+    }
+
+private:
+    size_t allow(size_t n) {
+        if (dead) {
+            return 0;
+        }
+        if (budget < 0 || (size_t)budget >= n) {
+            if (budget >= 0) {
+                budget -= n;
+            }
+            return n;
+        }
+        size_t granted = budget;
+        budget = 0;
+        dead = true;
+        return granted;
+    }
+
+    bool spend(size_t n) {
+        return allow(n) == n;
+    }
+
+    bool appendBytes(const char* path, const uint8_t* data, size_t len) {
+        size_t n = allow(len);
+        files[path].append((const char*)data, n);
+        return n == len;
+    }
+};
+
+class RecordingListener : public ImageCommitListener {
+public:
+    std::multiset<std::string> tracked;
+
+    void imageCommitted(const std::string& filename, size_t, RetentionClass cls, long) override {
+        if (cls != RETAIN_DAILY) {
+            tracked.insert(filename);
+        }
+    }
+};
+
+static std::string makeJpeg(size_t len, unsigned seed) {
+    std::string jpeg(len, '\0');
+    for (size_t i = 0; i < len; i++) {
+        jpeg[i] = (char)((seed * 31 + i * 7) & 0xFF);
+    }
+    jpeg[0] = (char)0xFF;
+    jpeg[1] = (char)0xD8;
+    jpeg[len - 2] = (char)0xFF;
+    jpeg[len - 1] = (char)0xD9;
+    return jpeg;
+}
+
+static bool save(ImageStore& store, const std::string& name, const std::string& jpeg, RetentionClass cls) {
+    return store.save((const uint8_t*)jpeg.data(), jpeg.size(), name, cls, 1700000000);
+}
+
+static bool endsWith(const std::string& s, const char* suffix) {
+    size_t n = strlen(suffix);
+    return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+// What must hold after any cut followed by recovery
+static void checkConsistent(FaultyFs& fs, const std::map<std::string, std::string>& images,
+                            const RecordingListener& listener) {
+    TEST_ASSERT_FALSE(fs.files.count(JOURNAL));
+
+    std::set<std::string> jpgs;
+    for (const auto& file : fs.files) {
+        TEST_ASSERT_FALSE_MESSAGE(endsWith(file.first, TEMP), file.first.c_str());
+        if (endsWith(file.first, ".jpg")) {
+            // Never a truncated or foreign image under a final name
+            auto expected = images.find(file.first);
+            TEST_ASSERT_TRUE_MESSAGE(expected != images.end(), file.first.c_str());
+            TEST_ASSERT_TRUE_MESSAGE(file.second == expected->second, file.first.c_str());
+            jpgs.insert(file.first);
+        }
+    }
+
+    // Every index line is whole, parses, and names an image that exists
+    const std::string& index = fs.files[INDEX];
+    TEST_ASSERT_TRUE(index.empty() || index.back() == '\n');
+
+    ImageStore reader(&fs, INDEX, JOURNAL, TEMP);
+    std::set<std::string> indexed;
+    IndexLine line;
+    size_t offset = 0;
+    size_t next;
+    int lines = 0;
+    while (reader.readLine(INDEX, offset, line, next)) {
+        TEST_ASSERT_TRUE_MESSAGE(jpgs.count(line.filename), line.filename.c_str());
+        TEST_ASSERT_TRUE_MESSAGE(indexed.insert(line.filename).second, "indexed twice");
+        TEST_ASSERT_EQUAL_INT(images.at(line.filename).size(), line.size);
+        offset = next;
+        lines++;
+    }
+    TEST_ASSERT_EQUAL_INT(index.size(), offset);
+    TEST_ASSERT_EQUAL_INT((int)jpgs.size(), lines);
+
+    // ...and every kept image is on its retention queue
+    for (const std::string& name : jpgs) {
+        TEST_ASSERT_TRUE_MESSAGE(listener.tracked.count(name), name.c_str());
+    }
+}
+
+struct Scenario {
+    FaultyFs fs;
+    RecordingListener listener;
+    std::map<std::string, std::string> images;
+};
+
+// Two images already on the card, then a save of a third cut after `budget`
+static void runCut(Scenario& sc, size_t newSize, long budget, long recoveryBudget) {
+    ImageStore store(&sc.fs, INDEX, JOURNAL, TEMP);
+    store.setListener(&sc.listener);
+    store.recover();
+
+    sc.images["/plant_1.jpg"] = makeJpeg(700, 1);
+    sc.images["/plant_2.jpg"] = makeJpeg(900, 2);
+    sc.images["/plant_3.jpg"] = makeJpeg(newSize, 3);
+    TEST_ASSERT_TRUE(save(store, "/plant_1.jpg", sc.images["/plant_1.jpg"], RETAIN_CAPTURE));
+    TEST_ASSERT_TRUE(save(store, "/plant_2.jpg", sc.images["/plant_2.jpg"], RETAIN_CAPTURE));
+
+    sc.fs.budget = budget;
+    bool saved = save(store, "/plant_3.jpg", sc.images["/plant_3.jpg"], RETAIN_CAPTURE);
+    TEST_ASSERT_TRUE(saved || sc.fs.dead);
+
+    // A cut can also land during recovery; the next boot has to finish it
+    if (recoveryBudget >= 0) {
+        sc.fs.reboot();
+        sc.fs.budget = recoveryBudget;
+        ImageStore interrupted(&sc.fs, INDEX, JOURNAL, TEMP);
+        interrupted.setListener(&sc.listener);
+        interrupted.recover();
+    }
+
+    sc.fs.reboot();
+    ImageStore rebooted(&sc.fs, INDEX, JOURNAL, TEMP);
+    rebooted.setListener(&sc.listener);
+    rebooted.recover();
+    checkConsistent(sc.fs, sc.images, sc.listener);
+
+    // A save that reported success must survive
+    if (saved) {
+        TEST_ASSERT_TRUE(sc.fs.files.count("/plant_3.jpg"));
+    }
+}
+
+// Budget a complete save of `size` bytes spends, i.e. every possible cut point
+static long saveCost(size_t size) {
+    Scenario sc;
+    ImageStore store(&sc.fs, INDEX, JOURNAL, TEMP);
+    store.recover();
+    sc.fs.budget = 1L << 30;
+    save(store, "/plant_3.jpg", makeJpeg(size, 3), RETAIN_CAPTURE);
+    return (1L << 30) - sc.fs.budget;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_clean_save_commits_indexes_and_tracks() {
+    Scenario sc;
+    ImageStore store(&sc.fs, INDEX, JOURNAL, TEMP);
+    store.setListener(&sc.listener);
+    store.recover();
+    sc.images["/plant_1.jpg"] = makeJpeg(500, 1);
+
+    TEST_ASSERT_TRUE(save(store, "/plant_1.jpg", sc.images["/plant_1.jpg"], RETAIN_CAPTURE));
+    TEST_ASSERT_EQUAL_STRING("1700000000,500,/plant_1.jpg\n", sc.fs.files[INDEX].c_str());
+    checkConsistent(sc.fs, sc.images, sc.listener);
+}
+
+void test_rejects_frame_without_eoi() {
+    Scenario sc;
+    ImageStore store(&sc.fs, INDEX, JOURNAL, TEMP);
+    store.recover();
+    std::string jpeg = makeJpeg(500, 1);
+    jpeg[499] = 0;
+    TEST_ASSERT_FALSE(save(store, "/plant_1.jpg", jpeg, RETAIN_CAPTURE));
+    TEST_ASSERT_EQUAL_INT(0, sc.fs.files.size());
+}
+
+// Every cut point of one save: journal, temp write, verify, rename, index, clear
+void test_cut_at_every_point() {
+    const size_t size = 600;
+    long cost = saveCost(size);
+    for (long budget = 0; budget <= cost; budget++) {
+        Scenario sc;
+        runCut(sc, size, budget, -1);
+    }
+}
+
+// Random image sizes and cut points, some with a second cut during recovery
+void test_cut_at_random_points() {
+    srand(1234);
+    for (int trial = 0; trial < 2000; trial++) {
+        size_t size = 4 + rand() % 4000;
+        long budget = rand() % (saveCost(size) + 1);
+        long recoveryBudget = (trial % 3 == 0) ? rand() % 64 : -1;
+        Scenario sc;
+        runCut(sc, size, budget, recoveryBudget);
+    }
+}
+
+// A torn last index line is cut back before recovery appends the journaled
+// entry, so the two never merge into one unparseable line
+void test_torn_index_tail_is_not_merged() {
+    Scenario sc;
+    sc.images["/plant_1.jpg"] = makeJpeg(300, 1);
+    sc.images["/plant_2.jpg"] = makeJpeg(400, 2);
+    sc.fs.files["/plant_1.jpg"] = sc.images["/plant_1.jpg"];
+    sc.fs.files["/plant_2.jpg"] = sc.images["/plant_2.jpg"];
+    sc.fs.files[INDEX] = "1700000000,300,/plant_1.jpg\n1700000060,400,/pla";
+    sc.fs.files[JOURNAL] = "1700000060,400,/plant_2.jpg,1\n";
+    sc.listener.tracked.insert("/plant_1.jpg");
+
+    ImageStore store(&sc.fs, INDEX, JOURNAL, TEMP);
+    store.setListener(&sc.listener);
+    RecoveryStats stats = store.recover();
+
+    TEST_ASSERT_EQUAL_INT(1, stats.recovered);
+    TEST_ASSERT_EQUAL_INT(1, stats.indexed);
+    TEST_ASSERT_EQUAL_STRING("1700000000,300,/plant_1.jpg\n1700000060,400,/plant_2.jpg\n",
+                             sc.fs.files[INDEX].c_str());
+    checkConsistent(sc.fs, sc.images, sc.listener);
+}
+
+// A leftover journal names a save that still needs finishing. Saving on top
+// of it would append to that journal and then delete it, orphaning the
+// interrupted temp file, so save() waits for recover().
+void test_save_waits_for_recovery_of_leftover_journal() {
+    Scenario sc;
+    sc.images["/plant_1.jpg"] = makeJpeg(300, 1);
+    sc.images["/plant_2.jpg"] = makeJpeg(400, 2);
+    sc.fs.files["/plant_1.jpg" TEMP] = sc.images["/plant_1.jpg"];
+    sc.fs.files[JOURNAL] = "1700000000,300,/plant_1.jpg,1\n";
+
+    ImageStore store(&sc.fs, INDEX, JOURNAL, TEMP);
+    store.setListener(&sc.listener);
+    TEST_ASSERT_FALSE(save(store, "/plant_2.jpg", sc.images["/plant_2.jpg"], RETAIN_CAPTURE));
+    TEST_ASSERT_EQUAL_STRING("1700000000,300,/plant_1.jpg,1\n", sc.fs.files[JOURNAL].c_str());
+    TEST_ASSERT_TRUE(sc.fs.files.count("/plant_1.jpg" TEMP));
+    TEST_ASSERT_FALSE(sc.fs.files.count("/plant_2.jpg"));
+
+    RecoveryStats stats = store.recover();
+    TEST_ASSERT_EQUAL_INT(1, stats.recovered);
+    TEST_ASSERT_TRUE(save(store, "/plant_2.jpg", sc.images["/plant_2.jpg"], RETAIN_CAPTURE));
+    checkConsistent(sc.fs, sc.images, sc.listener);
+}
+
+// A save whose journal could not be removed blocks the next save until
+// recover() runs again
+void test_failed_journal_remove_blocks_next_save() {
+    Scenario sc;
+    ImageStore store(&sc.fs, INDEX, JOURNAL, TEMP);
+    store.setListener(&sc.listener);
+    store.recover();
+    sc.images["/plant_1.jpg"] = makeJpeg(300, 1);
+    sc.images["/plant_2.jpg"] = makeJpeg(400, 2);
+
+    sc.fs.failRemove = JOURNAL;
+    TEST_ASSERT_TRUE(save(store, "/plant_1.jpg", sc.images["/plant_1.jpg"], RETAIN_CAPTURE));
+    TEST_ASSERT_TRUE(sc.fs.files.count(JOURNAL));
+    TEST_ASSERT_FALSE(store.isRecovered());
+
+    TEST_ASSERT_FALSE(save(store, "/plant_2.jpg", sc.images["/plant_2.jpg"], RETAIN_CAPTURE));
+    store.recover();
+    TEST_ASSERT_TRUE(save(store, "/plant_2.jpg", sc.images["/plant_2.jpg"], RETAIN_CAPTURE));
+    checkConsistent(sc.fs, sc.images, sc.listener);
+}
+
+void test_read_skips_malformed_lines() {
+    FaultyFs fs;
+    fs.files["/q"] = "1,10,/a.jpg\ngarbage\n2,x,/b.jpg\n3,30,/c.jpg\n\n4,4";
+    ImageStore store(&fs, INDEX, JOURNAL, TEMP);
+
+    IndexLine line;
+    size_t next;
+    TEST_ASSERT_TRUE(store.readLine("/q", 0, line, next));
+    TEST_ASSERT_EQUAL_STRING("/a.jpg", line.filename.c_str());
+    TEST_ASSERT_TRUE(store.readLine("/q", next, line, next));
+    TEST_ASSERT_EQUAL_STRING("/c.jpg", line.filename.c_str());
+    TEST_ASSERT_EQUAL_INT(30, line.size);
+
+    // Past the blank line, stopping before the partial one
+    size_t offset = next;
+    TEST_ASSERT_FALSE(store.readLine("/q", offset, line, next));
+    TEST_ASSERT_EQUAL_INT(fs.files["/q"].size() - 3, next);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_clean_save_commits_indexes_and_tracks);
+    RUN_TEST(test_rejects_frame_without_eoi);
+    RUN_TEST(test_cut_at_every_point);
+    RUN_TEST(test_cut_at_random_points);
+    RUN_TEST(test_torn_index_tail_is_not_merged);
+    RUN_TEST(test_save_waits_for_recovery_of_leftover_journal);
+    RUN_TEST(test_failed_journal_remove_blocks_next_save);
+    RUN_TEST(test_read_skips_malformed_lines);
+    return UNITY_END();
+}
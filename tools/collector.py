@@ -0,0 +1,167 @@
+#!/usr/bin/env python3
+"""Stand-in upload collector for exercising the firmware's push uploader.
+
+Accepts the uploader's POSTs (X-Filename header, JPEG body) and can inject
+failures so retry behaviour is visible on the wire:
+
+  --fail-first N   answer the first N attempts of every file with a 5xx
+  --fail-rate P    answer any attempt with a 5xx with probability P
+  --drop-rate P    close the connection without answering with probability P
+
+Every attempt is logged with the gap since the previous attempt at the same
+file, so exponential backoff shows up as doubling gaps that fall back to the
+minimum once a file succeeds. On Ctrl-C a summary lists duplicates (more
+than one per reboot means the cursor is not resuming cleanly) and, with
+--camera, any indexed file the collector never received.
+
+  python3 tools/collector.py --port 8080 --fail-first 3 --camera http://192.168.1.50
+"""
+
+import argparse
+import os
+import random
+import signal
+import threading
+import time
+import urllib.request
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+
+class Collector:
+    def __init__(self, args):
+        self.args = args
+        self.lock = threading.Lock()
+        self.attempts = {}    # filename -> attempt count
+        self.last_try = {}    # filename -> monotonic time of last attempt
+        self.received = {}    # filename -> times accepted
+        self.order = []       # accepted filenames, first arrival only
+        self.corrupt = []
+        self.connections = 0
+
+    def decide(self, filename):
+        """Returns (status or None to drop, attempt number, gap since last try)."""
+        with self.lock:
+            now = time.monotonic()
+            attempt = self.attempts.get(filename, 0) + 1
+            self.attempts[filename] = attempt
+            gap = now - self.last_try[filename] if filename in self.last_try else None
+            self.last_try[filename] = now
+
+        if attempt <= self.args.fail_first or random.random() < self.args.fail_rate:
+            return 503, attempt, gap
+        if random.random() < self.args.drop_rate:
+            return None, attempt, gap
+        return 200, attempt, gap
+
+    def accept(self, filename, body):
+        ok = len(body) >= 4 and body[:2] == b"\xff\xd8" and body[-2:] == b"\xff\xd9"
+        with self.lock:
+            count = self.received.get(filename, 0)
+            self.received[filename] = count + 1
+            if count == 0:
+                self.order.append(filename)
+            if not ok:
+                self.corrupt.append(filename)
+        if self.args.out and ok:
+            with open(os.path.join(self.args.out, os.path.basename(filename)), "wb") as f:
+                f.write(body)
+        return count, ok
+
+    def summary(self):
+        dupes = {name: n for name, n in self.received.items() if n > 1}
+        print("\n--- collector summary ---")
+        print(f"connections:     {self.connections}")
+        print(f"files received:  {len(self.order)}")
+        print(f"duplicates:      {len(dupes)}" + (f" {sorted(dupes)}" if dupes else ""))
+        print(f"corrupt bodies:  {len(self.corrupt)}" + (f" {self.corrupt}" if self.corrupt else ""))
+
+        if self.args.camera:
+            try:
+                with urllib.request.urlopen(self.args.camera.rstrip("/") + "/index?offset=0", timeout=10) as r:
+                    lines = r.read().decode(errors="replace").splitlines()
+            except OSError as e:
+                print(f"could not read camera index: {e}")
+                return
+            indexed = [line.split(",", 2)[2] for line in lines if line.count(",") >= 2]
+            missing = [name for name in indexed if name not in self.received]
+            print(f"indexed:         {len(indexed)}")
+            print(f"missing:         {len(missing)}" + (f" {missing[:20]}" if missing else ""))
+            # The uploader walks the index in order, so arrivals must follow it
+            positions = [indexed.index(n) for n in self.order if n in indexed]
+            print(f"in index order:  {'yes' if positions == sorted(positions) else 'NO'}")
+
+
+def make_handler(collector):
+    class Handler(BaseHTTPRequestHandler):
+        protocol_version = "HTTP/1.1"  # Keep-alive, like the uploader expects
+
+        def setup(self):
+            super().setup()
+            with collector.lock:
+                collector.connections += 1
+
+        def log_message(self, fmt, *args):
+            pass
+
+        def do_POST(self):
+            filename = self.headers.get("X-Filename", "?")
+            length = int(self.headers.get("Content-Length", 0))
+            body = self.rfile.read(length)
+
+            status, attempt, gap = collector.decide(filename)
+            gap_text = f"{gap * 1000:7.0f} ms since last try" if gap is not None else "first try"
+            stamp = time.strftime("%H:%M:%S")
+
+            if status is None:
+                print(f"{stamp} {filename} attempt {attempt}: DROP ({gap_text})")
+                self.close_connection = True
+                self.connection.close()
+                return
+
+            if status != 200:
+                print(f"{stamp} {filename} attempt {attempt}: {status} ({gap_text})")
+                self.send_response(status)
+                self.send_header("Content-Length", "0")
+                self.end_headers()
+                return
+
+            previous, ok = collector.accept(filename, body)
+            note = " DUPLICATE" if previous else ""
+            note += "" if ok else " CORRUPT"
+            print(f"{stamp} {filename} attempt {attempt}: 200, {len(body)} bytes ({gap_text}){note}")
+            self.send_response(200)
+            self.send_header("Content-Length", "2")
+            self.end_headers()
+            self.wfile.write(b"OK")
+
+    return Handler
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--port", type=int, default=8080)
+    parser.add_argument("--out", help="save accepted images here")
+    parser.add_argument("--fail-first", type=int, default=0)
+    parser.add_argument("--fail-rate", type=float, default=0.0)
+    parser.add_argument("--drop-rate", type=float, default=0.0)
+    parser.add_argument("--camera", help="camera base URL, to check for files never received")
+    parser.add_argument("--seed", type=int)
+    args = parser.parse_args()
+
+    random.seed(args.seed)
+    if args.out:
+        os.makedirs(args.out, exist_ok=True)
+
+    collector = Collector(args)
+    server = ThreadingHTTPServer(("", args.port), make_handler(collector))
+    print(f"Collector listening on :{args.port} (point UPLOAD_COLLECTOR_URL at http://<host>:{args.port}/upload)")
+    signal.signal(signal.SIGTERM, signal.default_int_handler)
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    collector.summary()
+
+
+if __name__ == "__main__":
+    main()
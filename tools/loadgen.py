@@ -0,0 +1,149 @@
+#!/usr/bin/env python3
+"""Concurrent-request load generator for the camera's web server.
+
+Holds N /stream viewers open while W workers issue /list and /download
+requests back to back, then reports per-route p50/p99 latency, the 503
+(pool full) rate, and per-viewer stream frame rates.
+
+  python3 tools/loadgen.py --host 192.168.1.50 --viewers 2 --workers 4 --duration 30
+"""
+
+import argparse
+import http.client
+import random
+import threading
+import time
+from collections import defaultdict
+
+BOUNDARY = b"--123456789000000000000987654321"  # PART_BOUNDARY in stream_protocol.h
+
+
+def percentile(values, p):
+    if not values:
+        return float("nan")
+    values = sorted(values)
+    return values[min(len(values) - 1, int(round(p / 100.0 * (len(values) - 1))))]
+
+
+class Results:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.latency = defaultdict(list)  # route -> seconds, successful requests only
+        self.status = defaultdict(lambda: defaultdict(int))  # route -> status -> count
+        self.viewers = []  # (time to first frame, frames, seconds, status)
+
+    def record(self, route, status, seconds):
+        with self.lock:
+            self.status[route][status] += 1
+            if status == 200:
+                self.latency[route].append(seconds)
+
+
+def fetch_files(host, port):
+    conn = http.client.HTTPConnection(host, port, timeout=10)
+    conn.request("GET", "/index?offset=0")
+    body = conn.getresponse().read().decode(errors="replace")
+    conn.close()
+    return [line.split(",", 2)[2].lstrip("/") for line in body.splitlines() if line.count(",") >= 2]
+
+
+def viewer(args, results, stop):
+    start = time.monotonic()
+    first = None
+    frames = 0
+    status = "error"
+    try:
+        conn = http.client.HTTPConnection(args.host, args.port, timeout=10)
+        conn.request("GET", "/stream")
+        resp = conn.getresponse()
+        status = resp.status
+        tail = b""
+        while resp.status == 200 and not stop.is_set():
+            chunk = resp.read1(16384)
+            if not chunk:
+                break
+            data = tail + chunk
+            count = data.count(BOUNDARY)
+            if count and first is None:
+                first = time.monotonic() - start
+            frames += count
+            tail = data[-len(BOUNDARY):]
+        conn.close()
+    except OSError:
+        pass
+    with results.lock:
+        results.viewers.append((first, frames, time.monotonic() - start, status))
+
+
+def worker(args, files, results, stop):
+    # One keep-alive connection per worker, reopened after errors
+    conn = None
+    while not stop.is_set():
+        if files and random.random() < args.download_ratio:
+            route, path = "/download", "/download?file=" + random.choice(files)
+        else:
+            route, path = "/list", "/list"
+
+        start = time.monotonic()
+        try:
+            if conn is None:
+                conn = http.client.HTTPConnection(args.host, args.port, timeout=30)
+            conn.request("GET", path)
+            resp = conn.getresponse()
+            resp.read()
+            status = resp.status
+            if resp.getheader("Connection", "").lower() == "close":
+                conn.close()
+                conn = None
+        except OSError:
+            status = "error"
+            if conn:
+                conn.close()
+            conn = None
+        results.record(route, status, time.monotonic() - start)
+
+        if status == 503:
+            time.sleep(args.retry_after)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--host", required=True)
+    parser.add_argument("--port", type=int, default=80)
+    parser.add_argument("--viewers", type=int, default=2, help="concurrent /stream clients")
+    parser.add_argument("--workers", type=int, default=4, help="concurrent /list and /download clients")
+    parser.add_argument("--duration", type=float, default=30)
+    parser.add_argument("--download-ratio", type=float, default=0.5)
+    parser.add_argument("--retry-after", type=float, default=0.5, help="pause after a 503")
+    args = parser.parse_args()
+
+    files = fetch_files(args.host, args.port)
+    print(f"{len(files)} indexed files; {args.viewers} viewers, {args.workers} workers for {args.duration:.0f}s")
+
+    results = Results()
+    stop = threading.Event()
+    threads = [threading.Thread(target=viewer, args=(args, results, stop)) for _ in range(args.viewers)]
+    threads += [threading.Thread(target=worker, args=(args, files, results, stop)) for _ in range(args.workers)]
+    for t in threads:
+        t.start()
+    time.sleep(args.duration)
+    stop.set()
+    for t in threads:
+        t.join()
+
+    print(f"\n{'route':<10} {'requests':>8} {'p50 ms':>8} {'p99 ms':>8} {'503 %':>7} {'errors':>7}")
+    for route in sorted(results.status):
+        counts = results.status[route]
+        total = sum(counts.values())
+        lat = results.latency[route]
+        print(f"{route:<10} {total:>8} {percentile(lat, 50) * 1000:>8.0f} {percentile(lat, 99) * 1000:>8.0f} "
+              f"{100.0 * counts.get(503, 0) / total:>7.1f} {counts.get('error', 0):>7}")
+
+    print("\nviewer  status  first frame ms  frames   fps")
+    for i, (first, frames, seconds, status) in enumerate(results.viewers):
+        first_ms = f"{first * 1000:.0f}" if first is not None else "-"
+        print(f"{i:<7} {status!s:<7} {first_ms:>14} {frames:>7} {frames / seconds:>5.1f}")
+
+
+if __name__ == "__main__":
+    main()